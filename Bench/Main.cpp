@@ -0,0 +1,310 @@
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+#include "../Common/Bitmap.hpp"
+#include "../Common/Font.hpp"
+#include "../Common/FontTable.hpp"
+#include "../Common/MappedFile.hpp"
+#include "../Common/Sprite.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+namespace fs = ::std::filesystem;
+
+// Every corpus comes from this seed, so runs compare like for like
+constexpr uint32_t Seed = 0x0d2f0c7;
+
+struct BenchResult {
+  string Name;
+  size_t NRep;
+  double Sec;      // per repetition
+  double Glyphs;   // per repetition; 0 if not applicable
+  double Pixels;
+  double Bytes;
+};
+
+static vector<BenchResult> Results;
+static double MinSec = 0.5;
+// Results nothing else reads are stored here so they are not optimized away
+static volatile uint32_t Keep;
+
+// Repeats Fn until MinSec has passed and records the per-repetition time of
+// the work Fn does each time
+template<class FnRun>
+static void Bench(const char* Name, double Glyphs, double Pixels, double Bytes, FnRun&& Fn) {
+  Fn(); // warm up caches and allocations
+  auto NRep = size_t{0};
+  auto T0 = chrono::steady_clock::now();
+  auto Sec = 0.0;
+  do {
+    Fn();
+    ++NRep;
+    Sec = chrono::duration<double>(chrono::steady_clock::now() - T0).count();
+  } while (Sec < MinSec);
+  auto& R = Results.emplace_back(BenchResult{Name, NRep, Sec / NRep, Glyphs, Pixels, Bytes});
+  printf("%-28s %8zu reps %10.3f ms", Name, NRep, R.Sec * 1e3);
+  if (Glyphs)
+    printf(" %10.0f glyphs/s", Glyphs / R.Sec);
+  if (Pixels)
+    printf(" %8.2f Mpx/s", Pixels / R.Sec / 1e6);
+  if (Bytes)
+    printf(" %8.2f MB/s", Bytes / R.Sec / 1e6);
+  printf("\n");
+}
+
+static Palette RandomPalette(mt19937& Rng) {
+  Palette Pal;
+  for (auto& P : Pal)
+    P = Pixel(Rng() & 0xffffff);
+  Pal[0] = Pixel(0);
+  return Pal;
+}
+
+// A W x H glyph whose pixels are, with probability Density, palette colors;
+// the rest are transparent
+static Bitmap RandomGlyph(mt19937& Rng, const Palette& Pal, size_t W, size_t H, double Density) {
+  Bitmap Bmp(W, H);
+  uniform_real_distribution<double> Coin;
+  for (auto y = size_t{0}; y < H; ++y)
+    for (auto x = size_t{0}; x < W; ++x)
+      Bmp[y][x] = Coin(Rng) < Density ? Pal[1 + Rng() % 255] : Pixel(0);
+  return Bmp;
+}
+
+// Glyph sets of several sizes and densities
+struct GlyphCorpus {
+  const char* Name;
+  size_t W, H;
+  double Density;
+};
+
+constexpr GlyphCorpus Corpora[]{
+  {"8px", 6, 8, 0.3},
+  {"16px", 12, 16, 0.3},
+  {"32px", 24, 32, 0.2},
+  {"64px", 48, 64, 0.5},
+};
+constexpr size_t NCorpusGlyph = 256;
+
+static Sprite RandomSprite(mt19937& Rng, const Palette& Pal, const GlyphCorpus& C) {
+  Sprite Spr(1, NCorpusGlyph);
+  for (auto i = size_t{0}; i < NCorpusGlyph; ++i)
+    Spr[0][i] = RandomGlyph(Rng, Pal, C.W, C.H, C.Density);
+  return Spr;
+}
+
+static size_t CountPixels(const Sprite& Spr) {
+  auto N = size_t{0};
+  for (auto i = size_t{0}; i < Spr.NFrm(); ++i)
+    N += Spr[0][i].Count();
+  return N;
+}
+
+// A TBL with one char per frame of Spr, from U+0020
+static FontTable MakeTable(const Sprite& Spr) {
+  FontTable Tbl;
+  Tbl.Hdr = {TblSign, 1, 0, (uint16_t) Spr.NFrm(), (uint8_t) Spr[0][0].Height(), (uint8_t) Spr[0][0].Height()};
+  Tbl.Chrs.reset(new TblChar[Spr.NFrm()]);
+  for (auto i = size_t{0}; i < Spr.NFrm(); ++i) {
+    auto& Bmp = Spr[0][i];
+    Tbl.Chrs[i] = {(uint16_t) (0x20 + i), 0, (uint8_t) Bmp.Width(), (uint8_t) Bmp.Height(), 1, 0, (uint16_t) i, 0, 0};
+  }
+  return Tbl;
+}
+
+// NLine lines of LineLen chars drawn from [Lo, Lo + N)
+static wstring RandomText(mt19937& Rng, wchar_t Lo, size_t N, size_t NLine, size_t LineLen) {
+  wstring Str;
+  for (auto i = size_t{0}; i < NLine; ++i) {
+    if (i)
+      Str += L'\n';
+    for (auto j = size_t{0}; j < LineLen; ++j)
+      Str += (wchar_t) (Lo + Rng() % N);
+  }
+  return Str;
+}
+
+static void MicroBenchmarks(const fs::path& TmpDir) {
+  mt19937 Rng(Seed);
+  auto Pal = RandomPalette(Rng);
+
+  // Palette search, uncached and through the encoder caches
+  {
+    vector<Pixel> Pixels(1 << 14);
+    for (auto& P : Pixels)
+      P = Pixel(Rng() & 0xffffff);
+    auto Sink = 0u;
+    Bench("Palette::Encode", 0, (double) Pixels.size(), 0, [&] {
+      for (auto& P : Pixels)
+        Sink += Pal.Encode(P);
+    });
+    // Antialiased glyphs reuse a few thousand colors
+    vector<Pixel> Repeated(1 << 18);
+    for (auto& P : Repeated)
+      P = Pixels[Rng() % 4096];
+    Bench("PalEncoder::Encode", 0, (double) Repeated.size(), 0, [&] {
+      PalEncoder Enc(Pal);
+      for (auto& P : Repeated)
+        Sink += Enc.Encode(P);
+    });
+    Keep = Sink;
+  }
+
+  for (auto& C : Corpora) {
+    auto Spr = RandomSprite(Rng, Pal, C);
+    auto NPixel = (double) CountPixels(Spr);
+    auto Dc6 = (TmpDir / "bench.dc6").string();
+    string Name;
+
+    Name = string("Sprite::SaveDc6 ") + C.Name;
+    Bench(Name.c_str(), NCorpusGlyph, NPixel, 0, [&] { Spr.SaveDc6(Dc6.c_str(), Pal); });
+    MappedFile File(Dc6.c_str());
+    Name = string("Sprite::ReadDc6 ") + C.Name;
+    Sprite Read;
+    Bench(Name.c_str(), NCorpusGlyph, NPixel, (double) File.Size(), [&] { Read.ReadDc6(File.Data(), File.Size(), Pal); });
+
+    // Every glyph at every position of a row, as text rendering draws them
+    Bitmap Canvas(C.W * 64, C.H);
+    Name = string("Bitmap::Draw ") + C.Name;
+    Bench(Name.c_str(), NCorpusGlyph, NPixel, 0, [&] {
+      for (auto i = size_t{0}; i < NCorpusGlyph; ++i)
+        Canvas.Draw(Spr[0][i], (int32_t) (i % 64 * C.W), 0);
+    });
+
+    auto Tbl = MakeTable(Spr);
+    Font Fnt;
+    Fnt.FromSprTbl(Spr, Tbl);
+    auto Text = RandomText(Rng, 0x20, NCorpusGlyph, 32, 80);
+    Bitmap Out;
+    Name = string("Font::Render ") + C.Name;
+    Bench(Name.c_str(), 32 * 80, 32.0 * 80 * C.W * C.H, 0, [&] { Fnt.RenderInto(Out, Text); });
+
+    Name = string("Bitmap::SavePng ") + C.Name;
+    auto Png = (TmpDir / "bench.png").string();
+    Bench(Name.c_str(), 0, (double) Out.Count(), (double) Out.Count() * sizeof(Pixel), [&] { Out.SavePng(Png.c_str()); });
+  }
+
+  // The largest TBL there can be
+  {
+    FontTable Tbl;
+    Tbl.Hdr = {TblSign, 1, 0, 65535, 8, 6};
+    Tbl.Chrs.reset(new TblChar[65535]);
+    for (auto i = 0u; i < 65535; ++i)
+      Tbl.Chrs[i] = {(uint16_t) i, 0, 6, 8, 1, 0, (uint16_t) i, 0, 0};
+    auto Path = (TmpDir / "bench.tbl").string();
+    Tbl.SaveTbl(Path.c_str());
+    auto Bytes = (double) (sizeof(TblHeader) + 65535 * sizeof(TblChar));
+    FontTable Read;
+    Bench("FontTable::ReadTbl", 65535, 0, Bytes, [&] { Read.ReadTbl(Path.c_str()); });
+  }
+}
+
+// Fonts bundled with the golden tests; HanStandIn is generated, see
+// GenHanStandIn.py next to it
+constexpr const char* FontDir = "D2MFC/Golden/Fonts";
+constexpr const char* LatinFont = "SourceCodePro-Regular.ttf";
+constexpr const char* CjkFont = "HanStandIn.woff2";
+
+// Finds a bundled font from the working directory or the executable,
+// whichever lies inside the repository
+static string BundledFont(const char* Exe, const char* Name) {
+  error_code Ec;
+  for (auto Start : {fs::current_path(Ec), fs::absolute(Exe, Ec).parent_path()})
+    for (auto Dir = Start; !Dir.empty(); Dir = Dir.parent_path()) {
+      auto Path = Dir / FontDir / Name;
+      if (fs::exists(Path, Ec))
+        return Path.string();
+      if (Dir == Dir.root_path())
+        break;
+    }
+  Abort("%s/%s not found above the working directory or %s; pass the font path, or - to skip", FontDir, Name, Exe);
+}
+
+// Renders [Lo, Hi] with Face at Size, lays the font out and saves it
+static void BuildBenchmark(const char* Name, const string& Face, uint32_t Size, uint32_t Lo, uint32_t Hi,
+  const fs::path& TmpDir) {
+  if (!fs::exists(Face))
+    Abort("%s: %s not found", Name, Face.c_str());
+  mt19937 Rng(Seed);
+  auto Pal = RandomPalette(Rng);
+  auto NGlyph = (double) (Hi - Lo + 1);
+  auto Pixels = 0.0;
+  auto Run = [&] {
+    Font Fnt;
+    Fnt.Size = Size;
+    Fnt.NThread = 0;
+    Fnt.Faces.emplace_back(Face);
+    for (auto Ch = Lo; Ch <= Hi; ++Ch) {
+      auto& G = Fnt.Glyphs[Ch];
+      G.reset(new FontGlyph);
+      G->Char = (uint16_t) Ch;
+      G->Size = Size;
+      G->FaceIdx = 0;
+    }
+    Fnt.RenderGlyphs();
+    Sprite Spr;
+    FontTable Tbl;
+    Fnt.Dump(Spr, Tbl);
+    Spr.SaveDc6((TmpDir / "build.dc6").string().c_str(), Pal);
+    Tbl.SaveTbl((TmpDir / "build.tbl").string().c_str());
+    Pixels = (double) CountPixels(Spr);
+  };
+  // The pixel count is only known once the font is built
+  Run();
+  Bench(Name, NGlyph, Pixels, 0, Run);
+}
+
+static void WriteJson(const char* Path) {
+  auto File = AutoFile(Path, "wb");
+  fprintf(File.Raw(), "{\n  \"seed\": %u,\n  \"benchmarks\": [", Seed);
+  for (auto i = size_t{0}; i < Results.size(); ++i) {
+    auto& R = Results[i];
+    fprintf(File.Raw(), "%s\n    {\"name\": \"%s\", \"repetitions\": %zu, \"seconds\": %.9f", i ? "," : "",
+      R.Name.c_str(), R.NRep, R.Sec);
+    if (R.Glyphs)
+      fprintf(File.Raw(), ", \"glyphsPerSec\": %.1f", R.Glyphs / R.Sec);
+    if (R.Pixels)
+      fprintf(File.Raw(), ", \"pixelsPerSec\": %.1f", R.Pixels / R.Sec);
+    if (R.Bytes)
+      fprintf(File.Raw(), ", \"mbPerSec\": %.3f", R.Bytes / R.Sec / 1e6);
+    fprintf(File.Raw(), "}");
+  }
+  fprintf(File.Raw(), "\n  ]\n}\n");
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg < 2 || NArg > 5) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Benchmark\n"
+      "\n"
+      "Usage: %s <Output>.json [<Latin>.ttf [<Cjk>.ttf [<MinSec>]]]\n"
+      "Time the palette search, DC6 and TBL I/O, drawing, text rendering and PNG\n"
+      "saving on generated glyphs, palettes and text, the same every run.\n"
+      "Also time full builds of U+0020-U+024F and of U+4E00-U+9FFF, by default\n"
+      "with the fonts in D2MFC/Golden/Fonts, found from the working directory\n"
+      "or the executable; use - to skip one. Each benchmark is repeated for at\n"
+      "least MinSec seconds (0.5 by default). Throughputs are written to Output.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  if (NArg == 5)
+    MinSec = strtod(Args[4], nullptr);
+  // Looked up first, so that a missing font stops the run before it starts
+  auto Latin = NArg >= 3 ? string(Args[2]) : BundledFont(Args[0], LatinFont);
+  auto Cjk = NArg >= 4 ? string(Args[3]) : BundledFont(Args[0], CjkFont);
+  auto TmpDir = fs::temp_directory_path() / "d2mfc-bench";
+  fs::create_directories(TmpDir);
+  MicroBenchmarks(TmpDir);
+  if (Latin != "-")
+    BuildBenchmark("Build Latin", Latin, 16, 0x20, 0x24f, TmpDir);
+  if (Cjk != "-")
+    BuildBenchmark("Build CJK", Cjk, 16, 0x4e00, 0x9fff, TmpDir);
+  fs::remove_all(TmpDir);
+  WriteJson(Args[1]);
+  printf("Results written to %s\n", Args[1]);
+  return 0;
+}
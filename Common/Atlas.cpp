@@ -0,0 +1,152 @@
+#include "Atlas.hpp"
+
+#include <filesystem>
+#include <map>
+#include <numeric>
+
+#include "Font.hpp"
+#include "Hash.hpp"
+
+SkylinePacker::SkylinePacker(uint32_t W, uint32_t H) : PageW(W), PageH(H), Sky{{0, 0, W}} {}
+
+uint32_t SkylinePacker::FitAt(size_t I, uint32_t W, uint32_t H) const noexcept {
+  if (Sky[I].X + W > PageW)
+    return ~0u;
+  auto Y = uint32_t{0};
+  for (auto Left = (int64_t) W; Left > 0; Left -= Sky[I++].W)
+    Y = max(Y, Sky[I].Y);
+  return Y + H <= PageH ? Y : ~0u;
+}
+
+bool SkylinePacker::Insert(uint32_t W, uint32_t H, uint32_t& X, uint32_t& Y) {
+  // Bottom-left rule: lowest top, then narrowest segment
+  auto Best = Sky.size();
+  auto BestTop = ~0u;
+  for (auto i = size_t{0}; i < Sky.size(); ++i) {
+    auto Top = FitAt(i, W, H);
+    if (Top == ~0u)
+      continue;
+    if (Top + H < BestTop || (Top + H == BestTop && Sky[i].W < Sky[Best].W)) {
+      Best = i;
+      BestTop = Top + H;
+    }
+  }
+  if (Best == Sky.size())
+    return false;
+  X = Sky[Best].X;
+  Y = BestTop - H;
+  if (!W)
+    return true;
+  // The new segment covers W pixels from X; the ones under it shrink or go
+  Sky.insert(Sky.begin() + Best, {X, BestTop, W});
+  auto i = Best + 1;
+  while (i < Sky.size() && Sky[i].X < X + W) {
+    auto End = Sky[i].X + Sky[i].W;
+    if (End <= X + W)
+      Sky.erase(Sky.begin() + i);
+    else {
+      Sky[i].W = End - (X + W);
+      Sky[i].X = X + W;
+      break;
+    }
+  }
+  // Neighbors at the same height merge
+  for (auto j = size_t{1}; j < Sky.size();) {
+    if (Sky[j - 1].Y == Sky[j].Y) {
+      Sky[j - 1].W += Sky[j].W;
+      Sky.erase(Sky.begin() + j);
+    }
+    else
+      ++j;
+  }
+  return true;
+}
+
+void FontAtlas::Pack(const Font& Fnt, uint32_t PageSize_, uint32_t Padding_) {
+  PageSize = PageSize_;
+  Padding = Padding_;
+  Pages.clear();
+  Rects.clear();
+  Chars.clear();
+  // Identical bitmaps, such as the frame shared by chars without an image of
+  // their own, get one rectangle
+  map<tuple<size_t, size_t, uint64_t>, uint32_t> Seen;
+  vector<const Bitmap*> Bmps;
+  for (auto Ch = size_t{0}; Ch < Fnt.Glyphs.size(); ++Ch) {
+    auto& G = Fnt.Glyphs[Ch];
+    if (!G || !G->HasBmp)
+      continue;
+    auto& Bmp = G->Bmp;
+    auto Key = make_tuple(Bmp.Width(), Bmp.Height(), Hash64(Bmp.Raw(), Bmp.Count() * sizeof(Pixel)));
+    auto It = Seen.find(Key);
+    if (It == Seen.end()) {
+      It = Seen.emplace(Key, (uint32_t) Bmps.size()).first;
+      Bmps.push_back(&Bmp);
+    }
+    else if (memcmp(Bmps[It->second]->Raw(), Bmp.Raw(), Bmp.Count() * sizeof(Pixel)))
+      Abort("Hash collision between the bitmaps of char %zu and another char", Ch);
+    Chars.emplace_back((uint16_t) Ch, It->second);
+  }
+  // Tallest first keeps the skyline flat
+  vector<uint32_t> Order(Bmps.size());
+  iota(Order.begin(), Order.end(), 0u);
+  stable_sort(Order.begin(), Order.end(), [&](uint32_t A, uint32_t B) {
+    return Bmps[A]->Height() > Bmps[B]->Height();
+  });
+  Rects.resize(Bmps.size());
+  vector<SkylinePacker> Packers;
+  for (auto Idx : Order) {
+    auto& Bmp = *Bmps[Idx];
+    auto W = (uint32_t) Bmp.Width(), H = (uint32_t) Bmp.Height();
+    if (W + Padding > PageSize || H + Padding > PageSize)
+      Abort("A %ux%u glyph does not fit %ux%u atlas pages", W, H, PageSize, PageSize);
+    auto& R = Rects[Idx];
+    R.W = W;
+    R.H = H;
+    if (!W || !H) {
+      R.Page = R.X = R.Y = 0;
+      continue;
+    }
+    auto Page = size_t{0};
+    while (Page < Packers.size() && !Packers[Page].Insert(W + Padding, H + Padding, R.X, R.Y))
+      ++Page;
+    if (Page == Packers.size()) {
+      Packers.emplace_back(PageSize, PageSize);
+      Packers.back().Insert(W + Padding, H + Padding, R.X, R.Y);
+    }
+    R.Page = (uint32_t) Page;
+  }
+  Pages.resize(max(Packers.size(), (size_t) 1));
+  for (auto& Page : Pages) {
+    Page.Resize(PageSize, PageSize);
+    Page.Fill({});
+  }
+  for (auto i = size_t{0}; i < Bmps.size(); ++i)
+    if (Rects[i].W && Rects[i].H)
+      Pages[Rects[i].Page].Draw(*Bmps[i], (int32_t) Rects[i].X, (int32_t) Rects[i].Y);
+}
+
+void FontAtlas::SaveBmFont(const Font& Fnt, const string& Base, const string& Face) const {
+  auto Name = filesystem::path(Base).filename().string();
+  for (auto i = size_t{0}; i < Pages.size(); ++i)
+    Pages[i].SavePng((Base + "_" + to_string(i) + ".png").c_str());
+  auto File = AutoFile((Base + ".fnt").c_str(), "wb");
+  // Lines are LnSpacing apart and glyphs hang BearY above the bottom of
+  // theirs, as Font::Render draws them
+  fprintf(File.Raw(),
+    "info face=\"%s\" size=%u bold=0 italic=0 charset=\"\" unicode=1 stretchH=100 smooth=1 aa=1 "
+    "padding=0,0,0,0 spacing=%u,%u\n",
+    Face.c_str(), Fnt.Size, Padding, Padding);
+  fprintf(File.Raw(), "common lineHeight=%u base=%u scaleW=%u scaleH=%u pages=%zu packed=0\n",
+    Fnt.LnSpacing, Fnt.LnSpacing, PageSize, PageSize, Pages.size());
+  for (auto i = size_t{0}; i < Pages.size(); ++i)
+    fprintf(File.Raw(), "page id=%zu file=\"%s_%zu.png\"\n", i, Name.c_str(), i);
+  fprintf(File.Raw(), "chars count=%zu\n", Chars.size());
+  for (auto [Ch, Idx] : Chars) {
+    auto& G = *Fnt.Glyphs[Ch];
+    auto& R = Rects[Idx];
+    fprintf(File.Raw(),
+      "char id=%u x=%u y=%u width=%u height=%u xoffset=%d yoffset=%d xadvance=%u page=%u chnl=15\n",
+      Ch, R.X, R.Y, R.W, R.H, G.BearX, (int32_t) Fnt.LnSpacing - G.BearY, G.Advance, R.Page);
+  }
+}
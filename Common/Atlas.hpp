@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "Common.hpp"
+
+struct Font;
+
+// Packs rectangles into a page, each placed where it leaves the skyline (the
+// top of what is packed so far) lowest
+class SkylinePacker {
+public:
+  SkylinePacker(uint32_t W, uint32_t H);
+
+  // Finds room for a W x H rectangle; false if the page has none
+  bool Insert(uint32_t W, uint32_t H, uint32_t& X, uint32_t& Y);
+private:
+  struct Segment {
+    uint32_t X;
+    uint32_t Y;
+    uint32_t W;
+  };
+
+  // Top of the rectangle if put at segment I, or ~0u if it does not fit
+  uint32_t FitAt(size_t I, uint32_t W, uint32_t H) const noexcept;
+
+  uint32_t PageW;
+  uint32_t PageH;
+  vector<Segment> Sky;
+};
+
+struct AtlasRect {
+  uint32_t Page;
+  uint32_t X;
+  uint32_t Y;
+  uint32_t W;
+  uint32_t H;
+};
+
+// The glyph bitmaps of a font on a few pages; chars with identical bitmaps
+// share one rectangle
+struct FontAtlas {
+  uint32_t PageSize{};
+  uint32_t Padding{};
+  vector<Bitmap> Pages;
+  vector<AtlasRect> Rects;
+  vector<pair<uint16_t, uint32_t>> Chars; // char and its index in Rects
+
+  // Packs the bitmaps of Fnt into PageSize x PageSize pages, Padding pixels
+  // apart
+  void Pack(const Font& Fnt, uint32_t PageSize, uint32_t Padding = 1);
+
+  // Writes the pages as <Base>_<page>.png and a text BMFont descriptor as
+  // <Base>.fnt, with the metrics of Fnt
+  void SaveBmFont(const Font& Fnt, const string& Base, const string& Face) const;
+};
@@ -1,8 +1,18 @@
 #include "AutoFile.hpp"
 #include "Bitmap.hpp"
+#include "Hash.hpp"
 
 #include <png.h>
 
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define BMP_SSSE3
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BMP_SSE2
+#endif
+
 namespace {
   constexpr uint32_t Dis2(uint32_t A, uint32_t B) {
     auto Diff = (int32_t) A - (int32_t) B;
@@ -27,9 +37,139 @@ namespace {
     return {R, G, B, A};
   }
 #endif
+
+#ifdef BMP_ALPHA
+  static_assert(sizeof(Pixel) == 4);
+#else
+  static_assert(sizeof(Pixel) == 3);
+#endif
+
+  // Eight 0/255 bytes per 1bpp byte, stored little-endian
+  struct MonoLut {
+    uint64_t Val[256];
+
+    constexpr MonoLut() : Val{} {
+      for (auto b = 0u; b < 256; ++b)
+        for (auto k = 0u; k < 8; ++k)
+          if (b & (0x80u >> k))
+            Val[b] |= (uint64_t) 0xff << (k * 8);
+    }
+  };
+
+  constexpr MonoLut MonoTbl;
+}
+
+void ExpandGray(Pixel* Dst, const uint8_t* Src, size_t N) noexcept {
+  auto i = size_t{0};
+#if defined(BMP_ALPHA) && defined(BMP_SSE2)
+  auto Out = (uint8_t*) Dst;
+  auto Zero = _mm_setzero_si128();
+  auto Ones = _mm_set1_epi8(-1);
+  for (; i + 16 <= N; i += 16) {
+    auto Gray = _mm_loadu_si128((const __m128i*) (Src + i));
+    auto Alpha = _mm_xor_si128(_mm_cmpeq_epi8(Gray, Zero), Ones);
+    auto GG = _mm_unpacklo_epi8(Gray, Gray);
+    auto GA = _mm_unpacklo_epi8(Gray, Alpha);
+    _mm_storeu_si128((__m128i*) (Out + i * 4), _mm_unpacklo_epi16(GG, GA));
+    _mm_storeu_si128((__m128i*) (Out + i * 4 + 16), _mm_unpackhi_epi16(GG, GA));
+    GG = _mm_unpackhi_epi8(Gray, Gray);
+    GA = _mm_unpackhi_epi8(Gray, Alpha);
+    _mm_storeu_si128((__m128i*) (Out + i * 4 + 32), _mm_unpacklo_epi16(GG, GA));
+    _mm_storeu_si128((__m128i*) (Out + i * 4 + 48), _mm_unpackhi_epi16(GG, GA));
+  }
+#elif !defined(BMP_ALPHA) && defined(BMP_SSSE3)
+  auto Out = (uint8_t*) Dst;
+  auto Sh0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+  auto Sh1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+  auto Sh2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+  for (; i + 16 <= N; i += 16) {
+    auto Gray = _mm_loadu_si128((const __m128i*) (Src + i));
+    _mm_storeu_si128((__m128i*) (Out + i * 3), _mm_shuffle_epi8(Gray, Sh0));
+    _mm_storeu_si128((__m128i*) (Out + i * 3 + 16), _mm_shuffle_epi8(Gray, Sh1));
+    _mm_storeu_si128((__m128i*) (Out + i * 3 + 32), _mm_shuffle_epi8(Gray, Sh2));
+  }
+#endif
+  for (; i < N; ++i) {
+    Dst[i].R = Src[i];
+    Dst[i].G = Src[i];
+    Dst[i].B = Src[i];
+#ifdef BMP_ALPHA
+    Dst[i].A = Src[i] ? 255 : 0;
+#endif
+  }
+}
+
+namespace {
+  constexpr uint32_t PopCount(uint64_t V) noexcept {
+    V = V - ((V >> 1) & 0x5555555555555555);
+    V = (V & 0x3333333333333333) + ((V >> 2) & 0x3333333333333333);
+    V = (V + (V >> 4)) & 0x0f0f0f0f0f0f0f0f;
+    return (uint32_t) ((V * 0x0101010101010101) >> 56);
+  }
+}
+
+PixelDiff DiffPixels(const Pixel* A, const Pixel* B, size_t N) noexcept {
+  PixelDiff Res{};
+  auto i = size_t{0};
+#ifdef BMP_SSE2
+  auto PA = (const uint8_t*) A;
+  auto PB = (const uint8_t*) B;
+  auto Max = _mm_setzero_si128();
+  auto AbsDiff = [&](size_t Off, __m128i& Eq) {
+    auto VA = _mm_loadu_si128((const __m128i*) (PA + Off));
+    auto VB = _mm_loadu_si128((const __m128i*) (PB + Off));
+    Max = _mm_max_epu8(Max, _mm_or_si128(_mm_subs_epu8(VA, VB), _mm_subs_epu8(VB, VA)));
+    Eq = _mm_cmpeq_epi8(VA, VB);
+  };
+#ifdef BMP_ALPHA
+  for (; i + 4 <= N; i += 4) {
+    __m128i Eq;
+    AbsDiff(i * 4, Eq);
+    // A pixel is unchanged if all 4 of its bytes are
+    auto Same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(Eq, _mm_set1_epi8(-1))));
+    Res.NChanged += 4 - PopCount((uint32_t) Same);
+  }
+#else
+  for (; i + 16 <= N; i += 16) {
+    __m128i Eq0, Eq1, Eq2;
+    AbsDiff(i * 3, Eq0);
+    AbsDiff(i * 3 + 16, Eq1);
+    AbsDiff(i * 3 + 32, Eq2);
+    // One bit per byte; a pixel is unchanged if its 3 bits are all set
+    auto Same = (uint64_t) (uint32_t) _mm_movemask_epi8(Eq0) | (uint64_t) (uint32_t) _mm_movemask_epi8(Eq1) << 16 |
+      (uint64_t) (uint32_t) _mm_movemask_epi8(Eq2) << 32;
+    Same &= Same >> 1 & Same >> 2 & 0x249249249249;
+    Res.NChanged += 16 - PopCount(Same);
+  }
+#endif
+  alignas(16) uint8_t Lanes[16];
+  _mm_store_si128((__m128i*) Lanes, Max);
+  for (auto Lane : Lanes)
+    Res.MaxDelta = max(Res.MaxDelta, Lane);
+#endif
+  for (; i < N; ++i) {
+    auto DR = (uint8_t) abs(A[i].R - B[i].R);
+    auto DG = (uint8_t) abs(A[i].G - B[i].G);
+    auto DB = (uint8_t) abs(A[i].B - B[i].B);
+    auto D = max(DR, max(DG, DB));
+#ifdef BMP_ALPHA
+    D = max(D, (uint8_t) abs(A[i].A - B[i].A));
+#endif
+    Res.MaxDelta = max(Res.MaxDelta, D);
+    Res.NChanged += D != 0;
+  }
+  return Res;
+}
+
+void UnpackMono(uint8_t* Dst, const uint8_t* Src, size_t N) noexcept {
+  auto NByte = N >> 3;
+  for (auto i = size_t{0}; i < NByte; ++i)
+    memcpy(Dst + i * 8, &MonoTbl.Val[Src[i]], 8);
+  if (N & 7)
+    memcpy(Dst + NByte * 8, &MonoTbl.Val[Src[NByte]], N & 7);
 }
 
-void Bitmap::SavePng(const char* Path) {
+void Bitmap::SavePng(const char* Path) const {
   auto File = AutoFile(Path, "wb");
   auto Png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
   if (!Png)
@@ -55,6 +195,115 @@ void Bitmap::SavePng(const char* Path) {
   png_destroy_write_struct(&Png, &Info);
 }
 
+PngWriter::PngWriter(const char* Path, size_t W, size_t H) : File(Path, "wb"), NLeft(H) {
+  Start(W, H, nullptr);
+}
+
+PngWriter::PngWriter(const char* Path, size_t W, size_t H, const Palette& Pal) :
+  File(Path, "wb"), NLeft(H), Indexed(true) {
+  Start(W, H, &Pal);
+}
+
+void PngWriter::Start(size_t W, size_t H, const Palette* Pal) {
+  auto P = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  if (!P)
+    Abort("Failed to create png write struct");
+  auto I = png_create_info_struct(P);
+  if (!I)
+    Abort("Failed to create png info struct");
+  Png = P;
+  Info = I;
+  if (setjmp(png_jmpbuf(P)))
+    Abort("Failed to write png");
+  if (Pal) {
+    png_set_IHDR(P, I, (uint32_t) W, (uint32_t) H, 8, PNG_COLOR_TYPE_PALETTE,
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_color Cols[256];
+    // Index 0 is transparent, drawn black like the background of RGB renders
+    Cols[0] = {0, 0, 0};
+    for (auto i = 1; i < 256; ++i)
+      Cols[i] = {(*Pal)[i].R, (*Pal)[i].G, (*Pal)[i].B};
+    png_set_PLTE(P, I, Cols, 256);
+#ifdef BMP_ALPHA
+    png_byte Trans = 0;
+    png_set_tRNS(P, I, &Trans, 1, nullptr);
+#endif
+  }
+  else
+    png_set_IHDR(P, I, (uint32_t) W, (uint32_t) H, 8,
+#ifdef BMP_ALPHA
+      PNG_COLOR_TYPE_RGBA,
+#else
+      PNG_COLOR_TYPE_RGB,
+#endif
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_init_io(P, File.Raw());
+  png_write_info(P, I);
+}
+
+PngWriter::~PngWriter() {
+  auto P = (png_structp) Png;
+  auto I = (png_infop) Info;
+  if (setjmp(png_jmpbuf(P)))
+    Abort("Failed to write png");
+  if (NLeft)
+    Abort("The png is missing %zu rows", NLeft);
+  png_write_end(P, I);
+  png_destroy_write_struct(&P, &I);
+}
+
+void PngWriter::WriteRow(const void* Row) {
+  auto P = (png_structp) Png;
+  if (setjmp(png_jmpbuf(P)))
+    Abort("Failed to write png");
+  if (!NLeft)
+    Abort("Too many rows written to the png");
+  png_write_row(P, (png_const_bytep) Row);
+  --NLeft;
+}
+
+void PngWriter::WriteRows(const Bitmap& Band, size_t NRow) {
+  Assert(!Indexed);
+  for (auto y = size_t{0}; y < NRow; ++y)
+    WriteRow(Band[y]);
+}
+
+void PngWriter::WriteRows(const IndexedBitmap& Band, size_t NRow) {
+  Assert(Indexed);
+  for (auto y = size_t{0}; y < NRow; ++y)
+    WriteRow(Band[y]);
+}
+
+Bitmap IndexedBitmap::ToBitmap(const Palette& Pal) const {
+  Bitmap Bmp(Width(), Height());
+  auto Src = Raw();
+  auto Dst = Bmp.Raw();
+  for (auto i = size_t{0}; i < Count(); ++i)
+    Dst[i] = Src[i] ? Pal[Src[i]] : Pixel{};
+  return Bmp;
+}
+
+void IndexedBitmap::SavePng(const char* Path, const Palette& Pal) const {
+  PngWriter Out(Path, Width(), Height(), Pal);
+  Out.WriteRows(*this, Height());
+}
+
+void IndexedBitmap::Draw(const IndexedBitmap& Bmp, int32_t X, int32_t Y, const uint8_t* Lut) {
+  auto XD = max(X, 0);
+  auto YD = max(Y, 0);
+  auto XS = XD - X;
+  auto YS = YD - Y;
+  auto W = min((int32_t) Width() - XD, (int32_t) Bmp.Width() - XS);
+  auto H = min((int32_t) Height() - YD, (int32_t) Bmp.Height() - YS);
+  for (auto y = 0; y < H; ++y) {
+    auto Src = Bmp[y + YS] + XS;
+    auto Dst = (*this)[y + YD] + XD;
+    for (auto x = 0; x < W; ++x)
+      if (Src[x])
+        Dst[x] = Lut ? Lut[Src[x]] : Src[x];
+  }
+}
+
 #ifdef BMP_ALPHA
 void Bitmap::Draw(const Bitmap& Bmp, int32_t X, int32_t Y) {
 #else
@@ -84,6 +333,73 @@ void Bitmap::Draw(const Bitmap& Bmp, int32_t X, int32_t Y, uint32_t Mask) {
     }
 }
 
+void Bitmap::DrawBand(const Bitmap& Bmp, int32_t X, int32_t Y) {
+  auto XD = X < 0 ? 0 : X;
+  auto YD = Y < 0 ? 0 : Y;
+  auto XS = X < 0 ? -X : 0;
+  auto YS = Y < 0 ? -Y : 0;
+  auto W = min((int32_t) Width() - XD, (int32_t) Bmp.Width() - XS);
+  auto H = min((int32_t) Height() - YD, (int32_t) Bmp.Height() - YS);
+  for (auto y = 0; y < H; ++y)
+    for (auto x = 0; x < W; ++x) {
+#ifdef BMP_ALPHA
+      (*this)[y + YD][x + XD] = AlphaBlend(Bmp[y + YS][x + XS], (*this)[y + YD][x + XD]);
+#else
+      if (Bmp[y + YS][x + XS].Rgb())
+        (*this)[y + YD][x + XD] = Bmp[y + YS][x + XS];
+#endif
+    }
+}
+
+bool Bitmap::ClipCoverage(const Coverage& Cov, int32_t X, int32_t Y, CovClip& Clip) {
+  Clip.XD = X < 0 ? 0 : X;
+  Clip.YD = Y < 0 ? 0 : Y;
+  Clip.XS = X < 0 ? -X : 0;
+  Clip.YS = Y < 0 ? -Y : 0;
+  Clip.W = min((int32_t) Width() - Clip.XD, (int32_t) Cov.NCol() - Clip.XS);
+  Clip.H = min((int32_t) Height() - Clip.YD, (int32_t) Cov.NRow() - Clip.YS);
+  if (Clip.W <= 0 || Clip.H <= 0) {
+    Warn("No bitmap is drawn at (%d,%d)->(%d,%d); canvas size is (%zux%zu)",
+      X, Y, X + (int32_t) Cov.NCol(), Y + (int32_t) Cov.NRow(), Width(), Height());
+    return false;
+  }
+  if ((size_t) Clip.W != Cov.NCol() || (size_t) Clip.H != Cov.NRow())
+    Warn("Bitmap is cropped from (%zu,%zu) to (%d,%d)", Cov.NCol(), Cov.NRow(), Clip.W, Clip.H);
+  return true;
+}
+
+void Bitmap::DrawCoverage(const Coverage& Cov, int32_t X, int32_t Y) {
+  CovClip C;
+  if (!ClipCoverage(Cov, X, Y, C))
+    return;
+  for (auto y = 0; y < C.H; ++y)
+    ExpandGray((*this)[y + C.YD] + C.XD, Cov[y + C.YS] + C.XS, C.W);
+}
+
+void Bitmap::BlendCoverage(const Coverage& Cov, const Pixel& Col, int32_t X, int32_t Y) {
+  CovClip C;
+  if (!ClipCoverage(Cov, X, Y, C))
+    return;
+  auto Mix = [](uint8_t D, uint8_t S, uint32_t A) {
+    return (uint8_t) ((D * (255 - A) + S * A + 127) / 255);
+  };
+  for (auto y = 0; y < C.H; ++y) {
+    auto Dst = (*this)[y + C.YD] + C.XD;
+    auto Src = Cov[y + C.YS] + C.XS;
+    for (auto x = 0; x < C.W; ++x) {
+      auto A = (uint32_t) Src[x];
+      if (!A)
+        continue;
+      Dst[x].R = Mix(Dst[x].R, Col.R, A);
+      Dst[x].G = Mix(Dst[x].G, Col.G, A);
+      Dst[x].B = Mix(Dst[x].B, Col.B, A);
+#ifdef BMP_ALPHA
+      Dst[x].A = 255;
+#endif
+    }
+  }
+}
+
 uint8_t Palette::Encode(const Pixel& Pix) const noexcept {
   auto Res = ~0u;
   auto MinDiff = ~0u;
@@ -125,13 +441,37 @@ void Palette::ReadDat(const char* Path) {
   }
 }
 
-PalEncoder::PalEncoder(const Palette& Pal) noexcept : Pal(&Pal) {}
+PalCache::Table& PalCache::Get(const Palette& Pal) {
+  lock_guard<mutex> Lock(Mtx);
+  auto& Res = Tables[Hash64(Pal.data(), sizeof(Pixel) * Pal.size())];
+  if (!Res)
+    Res.reset(new Table);
+  return *Res;
+}
+
+PalCache& PalCache::Global() {
+  static PalCache Cache;
+  return Cache;
+}
+
+PalEncoder::PalEncoder(const Palette& Pal) noexcept : Pal(&Pal), Shared(&PalCache::Global().Get(Pal)) {}
 
 uint8_t PalEncoder::Encode(const Pixel& Pix) noexcept {
   auto Res = Map.find(Pix.Rgb());
   if (Res != Map.end())
     return Res->second;
+  // The local map keeps the common colors off the shared lock
+  {
+    lock_guard<mutex> Lock(Shared->Mtx);
+    auto It = Shared->Map.find(Pix.Rgb());
+    if (It != Shared->Map.end()) {
+      Map.emplace(Pix.Rgb(), It->second);
+      return It->second;
+    }
+  }
   auto Idx = Pal->Encode(Pix);
   Map.emplace(Pix.Rgb(), Idx);
+  lock_guard<mutex> Lock(Shared->Mtx);
+  Shared->Map.emplace(Pix.Rgb(), Idx);
   return Idx;
 }
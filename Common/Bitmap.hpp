@@ -1,8 +1,11 @@
 #pragma once
 
 #include "Common.hpp"
+#include "AutoFile.hpp"
 #include "RcArray.hpp"
 
+#include <mutex>
+
 struct Pixel {
   uint8_t R;
   uint8_t G;
@@ -34,15 +37,54 @@ public:
   void ReadDat(const char* Path);
 };
 
+// Nearest colors per palette content, shared by the encoders of every
+// target and thread so each color is searched for once per process
+// Palette index of each RGB value
+using ColorMap = unordered_map<uint32_t, uint8_t, hash<uint32_t>, equal_to<uint32_t>,
+  MemAllocator<pair<const uint32_t, uint8_t>>>;
+
+class PalCache {
+public:
+  struct Table {
+    mutex Mtx;
+    ColorMap Map;
+  };
+
+  Table& Get(const Palette& Pal);
+
+  static PalCache& Global();
+private:
+  mutex Mtx;
+  unordered_map<uint64_t, unique_ptr<Table>> Tables;
+};
+
 class PalEncoder {
 public:
   PalEncoder(const Palette& Pal) noexcept;
   uint8_t Encode(const Pixel& Pix) noexcept;
 private:
   const Palette* Pal;
-  unordered_map<uint32_t, uint8_t> Map;
+  PalCache::Table* Shared;
+  ColorMap Map;
+};
+
+// 8-bit coverage as produced by the rasterizer; 0 is transparent
+using Coverage = RcArray<uint8_t>;
+
+// Expands N coverage values into gray pixels
+void ExpandGray(Pixel* Dst, const uint8_t* Src, size_t N) noexcept;
+
+struct PixelDiff {
+  size_t NChanged;  // pixels with any channel different
+  uint8_t MaxDelta; // largest difference of any channel
 };
 
+// Compares N pixels of A and B
+PixelDiff DiffPixels(const Pixel* A, const Pixel* B, size_t N) noexcept;
+
+// Unpacks N 1bpp values (most significant bit first) into 0/255 coverage
+void UnpackMono(uint8_t* Dst, const uint8_t* Src, size_t N) noexcept;
+
 class Bitmap : public RcArray<Pixel> {
 public:
   constexpr Bitmap() noexcept = default;
@@ -58,14 +100,85 @@ public:
 
   void Resize(size_t W, size_t H) { RcArray::Resize(H, W); }
 
-  void SavePng(const char* Path);
+  void SavePng(const char* Path) const;
 
 #ifdef BMP_ALPHA
   void Draw(const Bitmap& Bmp, int32_t X, int32_t Y);
 #else
   void Draw(const Bitmap& Bmp, int32_t X, int32_t Y, uint32_t Mask = 0x000000);
 #endif
+
+  // Same as Draw, but parts outside the canvas are dropped silently, as
+  // when the canvas holds one band of a larger image
+  void DrawBand(const Bitmap& Bmp, int32_t X, int32_t Y);
+
+  // Writes Cov as gray pixels at (X, Y), overwriting the covered area
+  void DrawCoverage(const Coverage& Cov, int32_t X, int32_t Y);
+  // Blends Col over the pixels at (X, Y), weighted by Cov
+  void BlendCoverage(const Coverage& Cov, const Pixel& Col, int32_t X, int32_t Y);
+private:
+  using RcArray::NRow;
+  using RcArray::NCol;
+
+  // Destination/source offsets and size of a clipped coverage draw
+  struct CovClip {
+    int32_t XD, YD, XS, YS, W, H;
+  };
+
+  bool ClipCoverage(const Coverage& Cov, int32_t X, int32_t Y, CovClip& Clip);
+};
+
+// 8-bit palette indices as stored in DC6; 0 is transparent
+class IndexedBitmap : public RcArray<uint8_t> {
+public:
+  constexpr IndexedBitmap() noexcept = default;
+  IndexedBitmap(const IndexedBitmap&) noexcept = default;
+  IndexedBitmap(IndexedBitmap&&) noexcept = default;
+  IndexedBitmap(size_t W, size_t H) noexcept : RcArray(H, W) {}
+
+  IndexedBitmap& operator =(const IndexedBitmap&) noexcept = default;
+  IndexedBitmap& operator =(IndexedBitmap&&) noexcept = default;
+
+  constexpr size_t Width() const noexcept { return NCol(); }
+  constexpr size_t Height() const noexcept { return NRow(); }
+
+  void Resize(size_t W, size_t H) { RcArray::Resize(H, W); }
+
+  // Looks every index up in Pal; 0 becomes black, or transparent with alpha
+  Bitmap ToBitmap(const Palette& Pal) const;
+
+  // Writes a paletted PNG
+  void SavePng(const char* Path, const Palette& Pal) const;
+
+  // Copies the nonzero indices of Bmp to (X, Y), through Lut if given; parts
+  // outside the canvas are dropped silently
+  void Draw(const IndexedBitmap& Bmp, int32_t X, int32_t Y, const uint8_t* Lut = nullptr);
 private:
   using RcArray::NRow;
   using RcArray::NCol;
 };
+
+// Writes a PNG row by row, top to bottom, so the image is never held whole
+class PngWriter final {
+public:
+  PngWriter(const char* Path, size_t W, size_t H);
+  // Paletted; rows are then written from IndexedBitmap
+  PngWriter(const char* Path, size_t W, size_t H, const Palette& Pal);
+  PngWriter(const PngWriter&) = delete;
+  ~PngWriter();
+
+  PngWriter& operator =(const PngWriter&) = delete;
+
+  // The first NRow rows of Band, which is as wide as the image
+  void WriteRows(const Bitmap& Band, size_t NRow);
+  void WriteRows(const IndexedBitmap& Band, size_t NRow);
+private:
+  void Start(size_t W, size_t H, const Palette* Pal);
+  void WriteRow(const void* Row);
+
+  AutoFile File;
+  void* Png{};  // png_struct, kept out of this header with the rest of png.h
+  void* Info{};
+  size_t NLeft{};
+  bool Indexed{};
+};
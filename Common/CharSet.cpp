@@ -0,0 +1,60 @@
+#include "CharSet.hpp"
+#include "FaceCache.hpp"
+
+void CharSet::FromFace(FT_Face Face) {
+  reset();
+  FT_UInt GIdx;
+  for (auto Ch = FT_Get_First_Char(Face, &GIdx); GIdx; Ch = FT_Get_Next_Char(Face, Ch, &GIdx)) {
+    if (Ch >= size())
+      break;
+    set(Ch);
+  }
+}
+
+string CharSet::Format(size_t MaxRange) const {
+  ostringstream Res;
+  Res << hex << setfill('0');
+  auto NRange = size_t{0};
+  for (auto Ch = size_t{0}; Ch < size(); ++Ch) {
+    if (!test(Ch))
+      continue;
+    auto Beg = Ch;
+    while (Ch + 1 < size() && test(Ch + 1))
+      ++Ch;
+    if (NRange++ == MaxRange) {
+      Res << ", ...";
+      break;
+    }
+    if (NRange > 1)
+      Res << ", ";
+    Res << "0x" << setw(4) << Beg;
+    if (Ch != Beg)
+      Res << "-0x" << setw(4) << Ch;
+  }
+  return Res.str();
+}
+
+const CharSet& CharSetCache::Get(FT_Library Lib, const string& Spec) {
+  auto [Path, Index] = ParseFaceSpec(Spec);
+  auto Key = make_pair(FaceCache::Global().Load(Path).Hash, Index);
+  {
+    lock_guard<mutex> Lock(Mtx);
+    auto It = Sets.find(Key);
+    if (It != Sets.end())
+      return *It->second;
+  }
+  auto Set = make_unique<CharSet>();
+  auto Face = FaceCache::Global().Open(Lib, Spec);
+  Set->FromFace(Face);
+  FtAss(FT_Done_Face(Face));
+  lock_guard<mutex> Lock(Mtx);
+  auto& Res = Sets[Key];
+  if (!Res)
+    Res = move(Set);
+  return *Res;
+}
+
+CharSetCache& CharSetCache::Global() {
+  static CharSetCache Cache;
+  return Cache;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <bitset>
+#include <map>
+#include <mutex>
+
+#include "FreeType.hpp"
+
+// One bit per BMP codepoint
+class CharSet : public bitset<65536> {
+public:
+  using bitset::bitset;
+
+  // Collects every BMP codepoint in the face's active charmap
+  void FromFace(FT_Face Face);
+
+  // Human-readable ranges such as "0x0100-0x017f, 0x3000", capped at MaxRange
+  string Format(size_t MaxRange = 32) const;
+};
+
+// Charmap coverage per (font file content, face index), so a font used by
+// several faces or targets walks its charmap once
+class CharSetCache {
+public:
+  // Spec is a face as accepted by FaceCache
+  const CharSet& Get(FT_Library Lib, const string& Spec);
+
+  static CharSetCache& Global();
+private:
+  mutex Mtx;
+  map<pair<uint64_t, FT_Long>, unique_ptr<CharSet>> Sets;
+};
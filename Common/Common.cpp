@@ -1,6 +1,14 @@
 #include "Common.hpp"
 
+#include <mutex>
+
+namespace {
+  // Keeps messages from parallel stages on separate lines
+  mutex LogMtx;
+}
+
 void Warn(const char* Fmt, ...) {
+  lock_guard<mutex> Lock(LogMtx);
   fputs("[WARN] ", stderr);
   va_list Args;
   va_start(Args, Fmt);
@@ -11,9 +19,13 @@ void Warn(const char* Fmt, ...) {
 
 [[noreturn]]
 void AbortV(const char* Fmt, va_list Args) {
-  fputs("[ABORT] ", stderr);
-  vfprintf(stderr, Fmt, Args);
-  fputc('\n', stderr);
+  {
+    // Released before exit() so that atexit handlers may still log
+    lock_guard<mutex> Lock(LogMtx);
+    fputs("[ABORT] ", stderr);
+    vfprintf(stderr, Fmt, Args);
+    fputc('\n', stderr);
+  }
   exit(EXIT_FAILURE);
 }
 
@@ -0,0 +1,161 @@
+#include "CompiledFont.hpp"
+
+#include <map>
+
+#include "AutoFile.hpp"
+#include "Font.hpp"
+#include "Hash.hpp"
+
+namespace {
+  constexpr char Magic[4] = {'D', '2', 'C', 'F'};
+  constexpr uint32_t Version = 1;
+
+  constexpr uint64_t Align(uint64_t Off) noexcept { return (Off + 15) & ~(uint64_t) 15; }
+}
+
+void CompiledFont::Save(const Font& Fnt, const Palette& Pal, const char* Path) {
+  vector<const FontGlyph*> Gs;
+  auto HasIdx = true;
+  for (auto& G : Fnt.Glyphs)
+    if (G) {
+      Gs.push_back(G.get());
+      HasIdx = HasIdx && G->Idx.Count() == G->Bmp.Count();
+    }
+  CompiledFontHeader Hdr{};
+  memcpy(Hdr.Magic, Magic, 4);
+  Hdr.Version = Version;
+  Hdr.PixelSize = (uint32_t) sizeof(Pixel);
+  Hdr.NGlyph = (uint32_t) Gs.size();
+  Hdr.Tbl.Sign = TblSign;
+  Hdr.Tbl.One = 1;
+  Hdr.Tbl.UnkHZ = Fnt.UnkHZ;
+  Hdr.Tbl.NChar = Cast<uint16_t>(Gs.size(), "Too many chars (%zu)", Gs.size());
+  Hdr.Tbl.LnSpacing = (uint8_t) Fnt.LnSpacing;
+  Hdr.Tbl.CapHeight = (uint8_t) Fnt.CapHeight;
+  Hdr.HasIdx = HasIdx;
+  for (auto i = 0; i < 256; ++i) {
+    Hdr.Pal[i][0] = Pal[i].R;
+    Hdr.Pal[i][1] = Pal[i].G;
+    Hdr.Pal[i][2] = Pal[i].B;
+  }
+  // Identical bitmaps, such as the frame shared by chars without an image of
+  // their own, are stored once. With indices, equal pixels may still have
+  // been quantized differently, so the indices are part of the key
+  vector<CompiledGlyph> Recs(Gs.size());
+  vector<const FontGlyph*> Blobs;
+  map<pair<uint64_t, size_t>, size_t> Seen;
+  vector<size_t> BlobOf(Gs.size());
+  auto Same = [HasIdx](const FontGlyph* A, const FontGlyph* B) {
+    return A->Bmp.Width() == B->Bmp.Width() && A->Bmp.Height() == B->Bmp.Height() &&
+      !memcmp(A->Bmp.Raw(), B->Bmp.Raw(), B->Bmp.Count() * sizeof(Pixel)) &&
+      (!HasIdx || !memcmp(A->Idx.Raw(), B->Idx.Raw(), B->Idx.Count()));
+  };
+  for (auto i = size_t{0}; i < Gs.size(); ++i) {
+    auto& Bmp = Gs[i]->Bmp;
+    auto Hash = Hash64(Bmp.Raw(), Bmp.Count() * sizeof(Pixel), Bmp.Width());
+    if (HasIdx)
+      Hash = Hash64(Gs[i]->Idx.Raw(), Gs[i]->Idx.Count(), Hash);
+    auto Key = make_pair(Hash, Bmp.Height());
+    auto It = Seen.find(Key);
+    if (It == Seen.end() || !Same(Blobs[It->second], Gs[i])) {
+      It = Seen.insert_or_assign(Key, Blobs.size()).first;
+      Blobs.push_back(Gs[i]);
+    }
+    BlobOf[i] = It->second;
+  }
+  vector<uint64_t> PixOffs(Blobs.size()), IdxOffs(Blobs.size());
+  auto Off = Align(sizeof(CompiledFontHeader) + sizeof(CompiledGlyph) * Recs.size());
+  for (auto b = size_t{0}; b < Blobs.size(); ++b) {
+    auto N = Blobs[b]->Bmp.Count();
+    PixOffs[b] = Off;
+    Off = Align(Off + N * sizeof(Pixel));
+    if (HasIdx) {
+      IdxOffs[b] = Off;
+      Off = Align(Off + N);
+    }
+  }
+  Hdr.FileSize = Off;
+  for (auto i = size_t{0}; i < Gs.size(); ++i) {
+    auto G = Gs[i];
+    auto& R = Recs[i];
+    R.Char = G->Char;
+    R.UnkTwo = G->UnkTwo;
+    R.HasBmp = G->HasBmp;
+    R.BearX = G->BearX;
+    R.BearY = G->BearY;
+    R.Advance = G->Advance;
+    R.Width = (uint32_t) G->Bmp.Width();
+    R.Height = (uint32_t) G->Bmp.Height();
+    R.PixOff = PixOffs[BlobOf[i]];
+    R.IdxOff = IdxOffs[BlobOf[i]];
+  }
+  auto File = AutoFile(Path, "wb");
+  File.Put(Hdr);
+  File.Put(Recs.data(), Recs.size());
+  auto Pos = (uint64_t) sizeof(CompiledFontHeader) + sizeof(CompiledGlyph) * Recs.size();
+  const uint8_t Zeros[16]{};
+  auto Pad = [&]() {
+    File.Put(Zeros, (size_t) (Align(Pos) - Pos));
+    Pos = Align(Pos);
+  };
+  Pad();
+  for (auto G : Blobs) {
+    File.Put(G->Bmp.Raw(), G->Bmp.Count());
+    Pos += G->Bmp.Count() * sizeof(Pixel);
+    Pad();
+    if (HasIdx) {
+      File.Put(G->Idx.Raw(), G->Idx.Count());
+      Pos += G->Idx.Count();
+      Pad();
+    }
+  }
+}
+
+bool CompiledFont::Open(const char* Path) {
+  File.Open(Path);
+  auto Ok = File.Size() >= sizeof(CompiledFontHeader) && !memcmp(Header().Magic, Magic, 4) &&
+    Header().Version == Version;
+  if (!Ok) {
+    Warn("%s is not a compiled font of version %u", Path, Version);
+    File.Close();
+    return false;
+  }
+  auto& Hdr = Header();
+  if (Hdr.PixelSize != sizeof(Pixel)) {
+    Warn("%s holds %u-byte pixels, but this build uses %zu-byte ones", Path, Hdr.PixelSize, sizeof(Pixel));
+    File.Close();
+    return false;
+  }
+  Ok = Hdr.FileSize == File.Size() &&
+    sizeof(CompiledFontHeader) + (uint64_t) Hdr.NGlyph * sizeof(CompiledGlyph) <= File.Size();
+  for (auto i = 0u; Ok && i < Hdr.NGlyph; ++i) {
+    auto& G = Glyphs()[i];
+    auto N = (uint64_t) G.Width * G.Height;
+    // Offsets are checked first so that a damaged one cannot overflow
+    Ok = G.PixOff <= File.Size() && N <= (File.Size() - G.PixOff) / sizeof(Pixel) &&
+      (!Hdr.HasIdx || (G.IdxOff <= File.Size() && N <= File.Size() - G.IdxOff)) &&
+      (!i || Glyphs()[i - 1].Char < G.Char);
+  }
+  if (!Ok) {
+    Warn("Compiled font %s is damaged", Path);
+    File.Close();
+  }
+  return Ok;
+}
+
+const CompiledGlyph* CompiledFont::Find(wchar_t Ch) const noexcept {
+  auto Beg = Glyphs(), End = Glyphs() + Header().NGlyph;
+  auto It = lower_bound(Beg, End, Ch, [](const CompiledGlyph& G, wchar_t Ch) { return G.Char < Ch; });
+  return It != End && It->Char == Ch ? It : nullptr;
+}
+
+Palette CompiledFont::Pal() const noexcept {
+  Palette Res;
+  for (auto i = 0; i < 256; ++i) {
+    Res[i] = Pixel(Header().Pal[i][0], Header().Pal[i][1], Header().Pal[i][2]);
+#ifdef BMP_ALPHA
+    Res[i].A = 255;
+#endif
+  }
+  return Res;
+}
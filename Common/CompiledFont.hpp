@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include "Bitmap.hpp"
+#include "FontTable.hpp"
+#include "MappedFile.hpp"
+
+struct Font;
+
+// A font as Font holds it after FromSprTbl, laid out to be used straight
+// from a mapping: the header, glyph records sorted by char, then the pixels
+// of every distinct bitmap, 16-byte aligned. Everything is little-endian.
+struct CompiledFontHeader {
+  char Magic[4];        // "D2CF"
+  uint32_t Version;
+  uint32_t PixelSize;   // sizeof(Pixel) of the writer, 4 with BMP_ALPHA
+  uint32_t NGlyph;
+  TblHeader Tbl;
+  uint32_t HasIdx;      // 1 if palette indices follow the pixels
+  uint64_t FileSize;
+  uint8_t Pal[256][3];  // RGB
+};
+
+struct CompiledGlyph {
+  uint16_t Char;
+  uint8_t UnkTwo;
+  uint8_t HasBmp;
+  int32_t BearX;
+  int32_t BearY;
+  uint32_t Advance;
+  uint32_t Width;
+  uint32_t Height;
+  uint64_t PixOff;      // Pixel[Height][Width]
+  uint64_t IdxOff;      // uint8_t[Height][Width], 0 without indices
+};
+
+static_assert(sizeof(CompiledFontHeader) == 808, "CompiledFontHeader is written as is");
+static_assert(sizeof(CompiledGlyph) == 40, "CompiledGlyph is written as is");
+
+class CompiledFont final {
+public:
+  CompiledFont() = default;
+  CompiledFont(const CompiledFont&) = delete;
+
+  CompiledFont& operator =(const CompiledFont&) = delete;
+
+  // Writes the glyphs of Fnt, and their indices if every glyph has them
+  static void Save(const Font& Fnt, const Palette& Pal, const char* Path);
+
+  // Maps Path and checks that it is a compiled font this build can use; the
+  // mapping stays until Close and backs every Font loaded from it
+  bool Open(const char* Path);
+  void Close() noexcept { File.Close(); }
+
+  const CompiledFontHeader& Header() const noexcept { return *(const CompiledFontHeader*) File.Data(); }
+  const CompiledGlyph* Glyphs() const noexcept {
+    return (const CompiledGlyph*) (File.Data() + sizeof(CompiledFontHeader));
+  }
+  const CompiledGlyph* Find(wchar_t Ch) const noexcept;
+  Palette Pal() const noexcept;
+
+  const Pixel* Pixels(const CompiledGlyph& G) const noexcept { return (const Pixel*) (File.Data() + G.PixOff); }
+  const uint8_t* Indices(const CompiledGlyph& G) const noexcept { return File.Data() + G.IdxOff; }
+private:
+  MappedFile File;
+};
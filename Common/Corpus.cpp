@@ -0,0 +1,130 @@
+#include "Corpus.hpp"
+
+#include <filesystem>
+#include <numeric>
+
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  // Both decoders pass every BMP codepoint to Put and return how many
+  // codepoints were outside the BMP or malformed
+  template<class Emit>
+  size_t DecodeUtf8(const uint8_t* P, const uint8_t* End, Emit&& Put) {
+    auto NSkip = size_t{0};
+    while (P < End) {
+      // Eight ASCII bytes at a time, which is most of a Latin corpus
+      uint64_t Word;
+      if (End - P >= 8 && (memcpy(&Word, P, 8), !(Word & 0x8080808080808080ull))) {
+        for (auto i = 0; i < 8; ++i)
+          Put(P[i]);
+        P += 8;
+        continue;
+      }
+      auto Lead = *P++;
+      if (Lead < 0x80) {
+        Put(Lead);
+        continue;
+      }
+      // 0xf5 and up would lead codepoints past U+10FFFF
+      auto NTail = Lead >= 0xf5 ? 0 : Lead >= 0xf0 ? 3 : Lead >= 0xe0 ? 2 : Lead >= 0xc0 ? 1 : 0;
+      if (!NTail || End - P < NTail) {
+        ++NSkip;
+        continue;
+      }
+      auto Cp = (uint32_t) Lead & (0x3fu >> NTail);
+      auto Ok = true;
+      for (auto i = 0; i < NTail && Ok; ++i) {
+        Ok = (P[i] & 0xc0) == 0x80;
+        Cp = Cp << 6 | (P[i] & 0x3fu);
+      }
+      if (!Ok) {
+        ++NSkip;
+        continue;
+      }
+      P += NTail;
+      // Overlong forms, such as C0 80 for NUL, are malformed
+      constexpr uint32_t MinCp[]{0, 0x80, 0x800, 0x10000};
+      if (Cp < MinCp[NTail] || Cp > 0xffff || (Cp >= 0xd800 && Cp < 0xe000))
+        ++NSkip;
+      else
+        Put((uint16_t) Cp);
+    }
+    return NSkip;
+  }
+
+  template<class Emit>
+  size_t DecodeUtf16(const uint8_t* P, const uint8_t* End, bool BigEndian, Emit&& Put) {
+    auto NSkip = size_t{0};
+    auto Unit = [&](const uint8_t* Q) {
+      return BigEndian ? (uint16_t) (Q[0] << 8 | Q[1]) : (uint16_t) (Q[1] << 8 | Q[0]);
+    };
+    for (; End - P >= 2; P += 2) {
+      auto U = Unit(P);
+      if (U < 0xd800 || U >= 0xe000) {
+        Put(U);
+        continue;
+      }
+      // A pair is one codepoint outside the BMP; a lone half is malformed
+      ++NSkip;
+      if (U < 0xdc00 && End - P >= 4 && (Unit(P + 2) & 0xfc00) == 0xdc00)
+        P += 2;
+    }
+    return NSkip;
+  }
+
+  template<class Emit>
+  size_t Decode(const uint8_t* Data, size_t Size, Emit&& Put) {
+    auto End = Data + Size;
+    if (Size >= 2 && Data[0] == 0xff && Data[1] == 0xfe)
+      return DecodeUtf16(Data + 2, End, false, Put);
+    if (Size >= 2 && Data[0] == 0xfe && Data[1] == 0xff)
+      return DecodeUtf16(Data + 2, End, true, Put);
+    if (Size >= 3 && Data[0] == 0xef && Data[1] == 0xbb && Data[2] == 0xbf)
+      Data += 3;
+    return DecodeUtf8(Data, End, Put);
+  }
+}
+
+size_t ScanText(const uint8_t* Data, size_t Size, CharSet& Set) {
+  return Decode(Data, Size, [&](uint16_t Ch) { Set.set(Ch); });
+}
+
+size_t DecodeText(const uint8_t* Data, size_t Size, wstring& Text) {
+  return Decode(Data, Size, [&](uint16_t Ch) { Text += (wchar_t) Ch; });
+}
+
+CharSet ScanCorpus(const vector<string>& Paths) {
+  vector<string> Files;
+  for (auto& Path : Paths) {
+    if (!fs::exists(Path))
+      Abort("Corpus path %s does not exist", Path.c_str());
+    if (!fs::is_directory(Path)) {
+      Files.emplace_back(Path);
+      continue;
+    }
+    for (auto& Entry : fs::recursive_directory_iterator(Path))
+      if (Entry.is_regular_file())
+        Files.emplace_back(Entry.path().string());
+  }
+  auto NSlot = ThreadPool::Global().NThread();
+  vector<CharSet> Sets(NSlot);
+  vector<size_t> NSkip(NSlot);
+  ThreadPool::Global().ParallelFor(Files.size(), 1,
+    [&](size_t Beg, size_t End, size_t Slot) {
+      for (auto i = Beg; i < End; ++i) {
+        MappedFile File(Files[i].c_str());
+        NSkip[Slot] += ScanText(File.Data(), File.Size(), Sets[Slot]);
+      }
+    }
+  );
+  CharSet Res;
+  for (auto& Set : Sets)
+    Res |= Set;
+  auto NSkipped = accumulate(NSkip.begin(), NSkip.end(), size_t{0});
+  if (NSkipped)
+    Warn("%zu codepoints in the corpus are outside the BMP or malformed and are ignored", NSkipped);
+  return Res;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include "CharSet.hpp"
+
+// Adds the BMP codepoints of Size bytes of text to Set. The text is UTF-16
+// if it starts with a UTF-16 BOM and UTF-8 otherwise. Returns how many
+// codepoints were outside the BMP or malformed, which are skipped.
+size_t ScanText(const uint8_t* Data, size_t Size, CharSet& Set);
+
+// Appends the BMP codepoints of the text to Text, as ScanText reads them
+size_t DecodeText(const uint8_t* Data, size_t Size, wstring& Text);
+
+// Codepoints used by the given files and by every file under the given
+// directories, scanned in parallel
+CharSet ScanCorpus(const vector<string>& Paths);
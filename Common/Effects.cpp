@@ -0,0 +1,101 @@
+#include "Effects.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FX_SSE2
+#endif
+
+void Sharpen(Coverage& Cov, uint32_t Amount) {
+  auto NRow = Cov.NRow();
+  auto NCol = Cov.NCol();
+  if (!Amount || !Cov.Count())
+    return;
+  // Horizontal pass into rows 1..NRow of Hor, which keeps a zero row on
+  // either side for the vertical pass; coverage outside the mask is 0
+  vector<uint8_t> Row(NCol + 2);
+  vector<int16_t> Hor((NRow + 2) * NCol);
+  for (auto i = size_t{0}; i < NRow; ++i) {
+    copy(Cov[i], Cov[i] + NCol, Row.begin() + 1);
+    auto Src = Row.data();
+    auto Dst = Hor.data() + (i + 1) * NCol;
+    auto j = size_t{0};
+#ifdef FX_SSE2
+    auto Zero = _mm_setzero_si128();
+    for (; j + 8 <= NCol; j += 8) {
+      auto L = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (Src + j)), Zero);
+      auto C = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (Src + j + 1)), Zero);
+      auto R = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (Src + j + 2)), Zero);
+      _mm_storeu_si128((__m128i*) (Dst + j), _mm_add_epi16(_mm_add_epi16(L, R), _mm_slli_epi16(C, 1)));
+    }
+#endif
+    for (; j < NCol; ++j)
+      Dst[j] = (int16_t) (Src[j] + 2 * Src[j + 1] + Src[j + 2]);
+  }
+  // Vertical pass fused with the unsharp mask. With Blur16 = 16 * blur and
+  // D = 16 * Cov - Blur16, the correction D * Amount / 1600 is computed as
+  // (D << 3) * M >> 16 with M = Amount * 512 / 100
+  auto M = (int32_t) min(Amount * 512u / 100u, 32767u);
+  for (auto i = size_t{0}; i < NRow; ++i) {
+    auto Up = Hor.data() + i * NCol;
+    auto Mid = Up + NCol;
+    auto Down = Mid + NCol;
+    auto Dst = Cov[i];
+    auto j = size_t{0};
+#ifdef FX_SSE2
+    auto Zero = _mm_setzero_si128();
+    auto Mul = _mm_set1_epi16((int16_t) M);
+    for (; j + 8 <= NCol; j += 8) {
+      auto Blur = _mm_add_epi16(
+        _mm_add_epi16(_mm_loadu_si128((const __m128i*) (Up + j)), _mm_loadu_si128((const __m128i*) (Down + j))),
+        _mm_slli_epi16(_mm_loadu_si128((const __m128i*) (Mid + j)), 1));
+      auto P = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (Dst + j)), Zero);
+      auto D = _mm_sub_epi16(_mm_slli_epi16(P, 4), Blur);
+      auto Res = _mm_add_epi16(P, _mm_mulhi_epi16(_mm_slli_epi16(D, 3), Mul));
+      _mm_storel_epi64((__m128i*) (Dst + j), _mm_packus_epi16(Res, Res));
+    }
+#endif
+    for (; j < NCol; ++j) {
+      auto Blur = Up[j] + 2 * Mid[j] + Down[j];
+      auto D = 16 * Dst[j] - Blur;
+      auto Res = Dst[j] + (D * 8 * M >> 16);
+      Dst[j] = (uint8_t) clamp(Res, 0, 255);
+    }
+  }
+}
+
+void Dilate(const Coverage& Src, uint32_t R, Coverage& Dst) {
+  auto NRow = Src.NRow() + 2 * R;
+  auto NCol = Src.NCol() + 2 * R;
+  // Horizontal maximum, into a buffer padded like Dst
+  Coverage Pad(NRow, NCol), Hor(NRow, NCol);
+  Pad.Fill(0);
+  for (auto i = size_t{0}; i < Src.NRow(); ++i)
+    copy(Src[i], Src[i] + Src.NCol(), Pad[i + R] + R);
+  Hor = Pad;
+  auto MaxInto = [](uint8_t* Acc, const uint8_t* Val, size_t N) {
+    auto j = size_t{0};
+#ifdef FX_SSE2
+    for (; j + 16 <= N; j += 16) {
+      auto A = _mm_loadu_si128((const __m128i*) (Acc + j));
+      auto V = _mm_loadu_si128((const __m128i*) (Val + j));
+      _mm_storeu_si128((__m128i*) (Acc + j), _mm_max_epu8(A, V));
+    }
+#endif
+    for (; j < N; ++j)
+      Acc[j] = max(Acc[j], Val[j]);
+  };
+  for (auto i = size_t{0}; i < NRow; ++i)
+    for (auto k = size_t{1}; k <= R; ++k) {
+      MaxInto(Hor[i] + k, Pad[i], NCol - k);
+      MaxInto(Hor[i], Pad[i] + k, NCol - k);
+    }
+  // Vertical maximum
+  Dst = Hor;
+  for (auto i = size_t{0}; i < NRow; ++i)
+    for (auto k = size_t{1}; k <= R; ++k) {
+      if (i >= k)
+        MaxInto(Dst[i], Hor[i - k], NCol);
+      if (i + k < NRow)
+        MaxInto(Dst[i], Hor[i + k], NCol);
+    }
+}
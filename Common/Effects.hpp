@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include "Bitmap.hpp"
+
+// Post-processing applied to every rendered glyph before layout
+struct GlyphEffects {
+  uint32_t Sharpen{0};      // unsharp amount in percent; a fix for bad hinting
+  uint32_t Outline{0};      // outline radius in pixels
+  Pixel OutlineCol{16, 16, 16};
+  int32_t ShadowX{0};       // shadow offset in pixels, drawn behind the outline
+  int32_t ShadowY{0};
+  Pixel ShadowCol{16, 16, 16};
+
+  bool Empty() const noexcept { return !Sharpen && !Outline && !ShadowX && !ShadowY; }
+  // Whether glyphs get layers other than their own coverage
+  bool Layered() const noexcept { return Outline || ShadowX || ShadowY; }
+};
+
+// Cov + Amount% * (Cov - blur), blurred by a separable [1 2 1] kernel
+void Sharpen(Coverage& Cov, uint32_t Amount);
+
+// Maximum of Src over a (2R+1)^2 square; Dst is Src padded by R on each side
+void Dilate(const Coverage& Src, uint32_t R, Coverage& Dst);
@@ -0,0 +1,40 @@
+#include "FaceCache.hpp"
+#include "Hash.hpp"
+
+FaceSpec ParseFaceSpec(const string& Spec) {
+  auto Pos = Spec.rfind('#');
+  if (Pos == string::npos || Pos + 1 == Spec.size())
+    return {Spec, 0};
+  auto Index = FT_Long{0};
+  for (auto i = Pos + 1; i < Spec.size(); ++i) {
+    if (!isdigit((unsigned char) Spec[i]))
+      return {Spec, 0};
+    Index = Index * 10 + (Spec[i] & 0xf);
+  }
+  return {Spec.substr(0, Pos), Index};
+}
+
+const FontData& FaceCache::Load(const string& Path) {
+  lock_guard<mutex> Lock(Mtx);
+  auto& Data = Files[Path];
+  if (!Data) {
+    Data.reset(new FontData);
+    Data->File.Open(Path.c_str());
+    Data->Hash = Hash64(Data->File.Data(), Data->File.Size());
+  }
+  return *Data;
+}
+
+FT_Face FaceCache::Open(FT_Library Lib, const string& Spec) {
+  auto [Path, Index] = ParseFaceSpec(Spec);
+  auto& Data = Load(Path);
+  FT_Face Face{};
+  if (FT_New_Memory_Face(Lib, Data.File.Data(), (FT_Long) Data.File.Size(), Index, &Face))
+    Abort("Failed to open face %ld of %s", Index, Path.c_str());
+  return Face;
+}
+
+FaceCache& FaceCache::Global() {
+  static FaceCache Cache;
+  return Cache;
+}
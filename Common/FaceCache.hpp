@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <mutex>
+
+#include "FreeType.hpp"
+#include "MappedFile.hpp"
+
+// A face is given as "path" or "path#index", the index selecting a face
+// inside a collection such as msyh.ttc
+struct FaceSpec {
+  string Path;
+  FT_Long Index{0};
+};
+
+FaceSpec ParseFaceSpec(const string& Spec);
+
+struct FontData {
+  MappedFile File;
+  uint64_t Hash{};
+};
+
+// Maps every font file once and lets any thread or FT_Library open faces
+// from the shared bytes; the mappings live as long as the cache
+class FaceCache {
+public:
+  const FontData& Load(const string& Path);
+
+  // The caller owns the returned face
+  FT_Face Open(FT_Library Lib, const string& Spec);
+
+  static FaceCache& Global();
+private:
+  mutex Mtx;
+  unordered_map<string, unique_ptr<FontData>> Files;
+};
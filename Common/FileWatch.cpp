@@ -0,0 +1,95 @@
+#include "FileWatch.hpp"
+
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  constexpr auto PollInterval = chrono::milliseconds(250);
+  // Saving often takes several writes or a write and a rename
+  constexpr auto Settle = chrono::milliseconds(100);
+
+  // A file missing in the middle of a save reads as unchanged
+  fs::file_time_type TimeOf(const fs::path& Path) {
+    error_code Ec;
+    auto Time = fs::last_write_time(Path, Ec);
+    return Ec ? fs::file_time_type::min() : Time;
+  }
+}
+
+FileWatch::FileWatch() {
+#ifdef __linux__
+  Fd = inotify_init1(IN_CLOEXEC);
+  if (Fd < 0)
+    Warn("inotify is unavailable, polling for changes instead");
+#endif
+}
+
+FileWatch::~FileWatch() {
+#ifdef __linux__
+  if (Fd >= 0)
+    close(Fd);
+#endif
+}
+
+void FileWatch::Add(const string& Path) {
+  auto Abs = fs::absolute(Path).lexically_normal();
+  Entries.push_back({Path, Abs, TimeOf(Abs)});
+#ifdef __linux__
+  // Watching the directory sees files replaced by a rename
+  if (Fd >= 0 && inotify_add_watch(Fd, Abs.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    Warn("Failed to watch %s", Abs.parent_path().c_str());
+#endif
+}
+
+vector<string> FileWatch::Poll() {
+  vector<string> Res;
+  for (auto& E : Entries) {
+    auto Time = TimeOf(E.Abs);
+    if (Time != fs::file_time_type::min() && Time != E.Time) {
+      E.Time = Time;
+      Res.push_back(E.Path);
+    }
+  }
+  return Res;
+}
+
+vector<string> FileWatch::Wait() {
+#ifdef __linux__
+  if (Fd >= 0) {
+    alignas(inotify_event) char Buf[4096];
+    for (;;) {
+      if (read(Fd, Buf, sizeof(Buf)) < 0) {
+        if (errno == EINTR)
+          continue;
+        Abort("Failed to read file events");
+      }
+      pollfd Pfd{Fd, POLLIN, 0};
+      while (poll(&Pfd, 1, (int) Settle.count()) > 0 && read(Fd, Buf, sizeof(Buf)) > 0)
+        ;
+      auto Res = Poll();
+      if (!Res.empty())
+        return Res;
+    }
+  }
+#endif
+  for (;;) {
+    auto Res = Poll();
+    if (!Res.empty()) {
+      this_thread::sleep_for(Settle);
+      for (auto& Path : Poll())
+        if (find(Res.begin(), Res.end(), Path) == Res.end())
+          Res.push_back(Path);
+      return Res;
+    }
+    this_thread::sleep_for(PollInterval);
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <filesystem>
+
+// Waits for changes to a set of files. Linux watches their directories
+// through inotify, so editors that save by renaming are seen too; elsewhere,
+// or if inotify is unavailable, modification times are polled.
+class FileWatch final {
+public:
+  FileWatch();
+  FileWatch(const FileWatch&) = delete;
+  ~FileWatch();
+
+  FileWatch& operator =(const FileWatch&) = delete;
+
+  void Add(const string& Path);
+
+  // Blocks until at least one file changed and returns the changed paths as
+  // given to Add. Changes arriving shortly after the first are coalesced.
+  vector<string> Wait();
+private:
+  struct Entry {
+    string Path;
+    ::std::filesystem::path Abs;
+    ::std::filesystem::file_time_type Time;
+  };
+
+  vector<string> Poll();
+
+  vector<Entry> Entries;
+#ifdef __linux__
+  int Fd{-1}; // inotify; events only wake Wait, which then compares times
+#endif
+};
@@ -1,20 +1,24 @@
-#include <windows.h>
 #include "Font.hpp"
 
 #include <math.h>
-#include <ft2build.h>
 #include <map>
 #include <algorithm>
-#include FT_FREETYPE_H
 
-#include "FontLoader.hpp"
-
-#define FtAss(e_) ((void) (!(e_) || (Abort("FreeType call failed: " # e_ ""), 0)))
+#include "CharSet.hpp"
+#include "CompiledFont.hpp"
+#include "FaceCache.hpp"
+#include "FreeType.hpp"
+#include "Gamma.hpp"
+#include "GlyphCache.hpp"
+#include "Sdf.hpp"
+#include "T2S.hpp"
+#include "ThreadPool.hpp"
 
 void Font::Clear() {
   fill(Glyphs.begin(), Glyphs.end(), nullptr);
   Pals.clear();
   Faces.clear();
+  Fallbacks.clear();
   Size = 0;
   LnSpacingOff = 1;
   CapHeightOff = 0;
@@ -47,7 +51,42 @@ void Font::FromSprTbl(Sprite& Spr, FontTable& Tbl) {
     G->Advance = C.Width;
     if (C.Dc6Index >= Spr.NFrm())
       Abort("DC6 index (%u) is too large for char (%u): should be less than %zu", C.Dc6Index, G->Char, Spr.NFrm());
-    G->Bmp = move(Spr[0][C.Dc6Index]);
+    // Chars without an image of their own share frame 0, so it is copied
+    G->Bmp = Spr[0][C.Dc6Index];
+  }
+}
+
+void Font::FromSprTbl(IndexedSprite& Spr, FontTable& Tbl, const Palette& Pal) {
+  Sprite Rgb(Spr.NDir(), Spr.NFrm());
+  for (auto IDir = size_t{0}; IDir < Spr.NDir(); ++IDir)
+    for (auto IFrm = size_t{0}; IFrm < Spr.NFrm(); ++IFrm)
+      Rgb[IDir][IFrm] = Spr[IDir][IFrm].ToBitmap(Pal);
+  FromSprTbl(Rgb, Tbl);
+  for (auto i = 0u; i < Spr.NFrm(); ++i)
+    Glyphs[Tbl.Chrs[i].Char]->Idx = Spr[0][Tbl.Chrs[i].Dc6Index];
+}
+
+void Font::FromCompiled(const CompiledFont& Cf) {
+  auto& Hdr = Cf.Header();
+  Clear();
+  Size = Hdr.Tbl.LnSpacing;
+  LnSpacing = Hdr.Tbl.LnSpacing;
+  CapHeight = Hdr.Tbl.CapHeight;
+  UnkHZ = Hdr.Tbl.UnkHZ;
+  for (auto i = 0u; i < Hdr.NGlyph; ++i) {
+    auto& C = Cf.Glyphs()[i];
+    auto& G = Glyphs[C.Char];
+    G.reset(new FontGlyph);
+    G->Char = C.Char;
+    G->Size = Hdr.Tbl.LnSpacing;
+    G->UnkTwo = C.UnkTwo;
+    G->HasBmp = C.HasBmp;
+    G->BearX = C.BearX;
+    G->BearY = C.BearY;
+    G->Advance = C.Advance;
+    G->Bmp.Borrow(Cf.Pixels(C), C.Height, C.Width);
+    if (Hdr.HasIdx)
+      G->Idx.Borrow(Cf.Indices(C), C.Height, C.Width);
   }
 }
 
@@ -177,133 +216,376 @@ static void dumpGlyphy(wchar_t c, FT_Face face, FT_GlyphSlot glyph, uint32_t siz
     getFontMetrics(face, glyph, size, nullptr, nullptr, nullptr, nullptr);
 }
 
-static void fillEmpty(FontGlyph * G)
-{
-    G->Valid = false;
-    G->BearX = 0;
-    G->BearY = 1;
-    G->Advance = 1;
-    G->HasBmp = 1;
-    G->Bmp.Resize(1, 1);
-    G->Bmp.Fill({});
-}
-
-wchar_t ToSimple(wchar_t _str)
-{
-    wchar_t src[] = { _str, L'\0', };
-    wchar_t dest[2] = { L'\0' };
-    int ret = LCMapStringW(0x0804,LCMAP_SIMPLIFIED_CHINESE, &src[0], 1, &dest[0], 2);
-    if (ret == 0) {
-        Warn("Convert failed, error %lu\n", GetLastError());
-        return _str;
-    }
-    return dest[0];
+void FontGlyph::FillEmpty() {
+  Valid = false;
+  BearX = 0;
+  BearY = 1;
+  Advance = 1;
+  HasBmp = 1;
+  Bmp.Resize(1, 1);
+  Bmp.Fill({});
 }
 
-class FontInfoImpl {
-public:
-    FontInfoImpl(const LOGFONTW& lf, int size):
-        mInfo(lf, size)
-    {
-        mFallbacks.push_back(new FontInfo(L"Microsoft Sans Serif", size));
-        mFallbacks.push_back(new FontInfo(L"Microsoft YaHei UI", size));
+namespace {
+  // Glyphs per chunk handed to a render worker; the list is sorted by
+  // (face, size), so a chunk rarely needs to switch faces
+  constexpr size_t RenderChunk = 64;
+
+  // FreeType faces are not thread-safe, so every render slot owns a library
+  // and opens its own face for each face index it comes across
+  class FtWorker {
+  public:
+    FtWorker() { FtAss(FT_Init_FreeType(&Lib)); }
+    FtWorker(const FtWorker&) = delete;
+    ~FtWorker() {
+      for (auto Face : FtFaces)
+        if (Face)
+          FtAss(FT_Done_Face(Face));
+      FtAss(FT_Done_FreeType(Lib));
     }
 
-    ~FontInfoImpl()
-    {
-        for (auto fallbacks: mFallbacks) {
-            delete fallbacks;
-        }
+    FtWorker& operator =(const FtWorker&) = delete;
+
+    FT_Face Select(const vector<string>& Faces, int32_t FaceIdx, uint32_t Size) {
+      if (FtFaces.size() <= (size_t) FaceIdx) {
+        FtFaces.resize(FaceIdx + 1);
+        Sizes.resize(FaceIdx + 1);
+      }
+      auto& Face = FtFaces[FaceIdx];
+      if (!Face) {
+        Face = FaceCache::Global().Open(Lib, Faces[FaceIdx]);
+        Sizes[FaceIdx] = 0;
+      }
+      if (Sizes[FaceIdx] != Size) {
+        FtAss(FT_Set_Pixel_Sizes(Face, 0, Size));
+        Sizes[FaceIdx] = Size;
+      }
+      return Face;
     }
+  private:
+    FT_Library Lib{};
+    vector<FT_Face> FtFaces;
+    vector<uint32_t> Sizes;
+  };
+
+  // Lut maps anti-aliased coverage, nullptr to keep it as is
+  void RenderGlyph(FT_Face Face, FontGlyph* G, const uint8_t* Lut) {
+    auto FtgIdx = FT_Get_Char_Index(Face, G->Source);
+    if (!FtgIdx) {
+      Warn("No glyph found for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
+      G->Valid = false;
+      G->BearX = 0;
+      G->BearY = 1;
+      G->Advance = 1;
+      G->HasBmp = 1;
+      G->Bmp.Resize(1, 1);
+      G->Bmp.Fill({});
+      return;
+    }
+    FtAss(FT_Load_Glyph(Face, FtgIdx, G->AntiAliasing ? FT_LOAD_DEFAULT : FT_LOAD_TARGET_MONO | FT_LOAD_MONOCHROME));
+    if (Face->glyph->format != FT_GLYPH_FORMAT_BITMAP)
+      FtAss( FT_Render_Glyph(Face->glyph, G->AntiAliasing ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO));
+    auto& Ftg = Face->glyph;
+    auto& Ftb = Face->glyph->bitmap;
+    if (!Ftb.width || !Ftb.rows) {
+      Warn("Empty bitmap generated for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
+      G->Valid = false;
+      G->BearX = 0;
+      G->BearY = 1;
+      G->Advance = Ftg->advance.x >> 6;
+      G->HasBmp = 1;
+      G->Bmp.Resize(1, 1);
+      G->Bmp.Fill({});
+      return;
+    }
+    dumpGlyphy(G->Char, Face, Ftg, G->Size);
+    G->BearX = Ftg->bitmap_left;
+    G->BearY = Ftg->bitmap_top;
+    G->Advance = Ftg->advance.x >> 6;
+    G->HasBmp = 2;
+    G->Mask.Resize(Ftb.rows, Ftb.width);
+    if (G->Blank) {
+      G->Mask.Fill(0);
+      return;
+    }
+    for (auto i = 0u; i < Ftb.rows; ++i) {
+      auto Row = Ftb.buffer + (ptrdiff_t) i * Ftb.pitch;
+      if (!G->AntiAliasing)
+        UnpackMono(G->Mask[i], Row, Ftb.width);
+      else if (Lut)
+        transform(Row, Row + Ftb.width, G->Mask[i], [Lut](uint8_t Col) { return Lut[Col]; });
+      else
+        copy(Row, Row + Ftb.width, G->Mask[i]);
+    }
+  }
 
-    const TEXTMETRIC& metric() { return mInfo.metric(); }
+  // Same as RenderGlyph, but scales the cached field of Face at SdfSize
+  void RenderSdfGlyph(FT_Face Face, const string& Spec, uint32_t SdfSize, FontGlyph* G, const uint8_t* Lut) {
+    auto& Sdf = SdfCache::Global().Get(Face, Spec, G->Source, SdfSize);
+    if (!Sdf.Exists) {
+      Warn("No glyph found for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
+      G->FillEmpty();
+      return;
+    }
+    auto Scale = (float) G->Size / SdfSize;
+    if (!Sdf.Field.Count()) {
+      Warn("Empty bitmap generated for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
+      G->FillEmpty();
+      G->Advance = (uint32_t) lround(Sdf.Advance * Scale / 64);
+      return;
+    }
+    SampleSdf(Sdf, Scale, G->AntiAliasing, G->Mask, G->BearX, G->BearY);
+    G->Advance = (uint32_t) lround(Sdf.Advance * Scale / 64);
+    G->HasBmp = 2;
+    if (G->Blank)
+      G->Mask.Fill(0);
+    else if (G->AntiAliasing && Lut)
+      transform(G->Mask.Raw(), G->Mask.Raw() + G->Mask.Count(), G->Mask.Raw(), [Lut](uint8_t Col) { return Lut[Col]; });
+  }
 
-    bool getBitmap(wchar_t c, Bitmap& bitmap, GLYPHMETRICS * metrics=nullptr)
-    {
-        bool ok = false;
+  // Same metrics as RenderGlyph with a blank mask; FreeType presets the
+  // bitmap box when loading, so nothing is rasterized
+  void MeasureGlyph(FT_Face Face, FontGlyph* G) {
+    auto FtgIdx = FT_Get_Char_Index(Face, G->Source);
+    if (!FtgIdx) {
+      G->FillEmpty();
+      return;
+    }
+    FtAss(FT_Load_Glyph(Face, FtgIdx, G->AntiAliasing ? FT_LOAD_DEFAULT : FT_LOAD_TARGET_MONO | FT_LOAD_MONOCHROME));
+    auto& Ftg = Face->glyph;
+    auto& Ftb = Face->glyph->bitmap;
+    if (!Ftb.width || !Ftb.rows) {
+      G->FillEmpty();
+      G->Advance = Ftg->advance.x >> 6;
+      return;
+    }
+    G->BearX = Ftg->bitmap_left;
+    G->BearY = Ftg->bitmap_top;
+    G->Advance = Ftg->advance.x >> 6;
+    G->HasBmp = 2;
+    G->Mask.Resize(Ftb.rows, Ftb.width);
+    G->Mask.Fill(0);
+  }
 
-        ok = mInfo.getBitmap(c, bitmap, metrics);
-        if (ok) {
-            return true;
-        }
-        for (auto& fallback: mFallbacks) {
-            ok = fallback->getBitmap(c, bitmap, metrics);
-            if (ok) {
-                Warn("Replace char %u(0x%x) with fallback", c, c);
-                return true;
-            }
-        }
-        return false;
+  // Same metrics as RenderSdfGlyph with a blank mask, without a field
+  void MeasureSdfGlyph(FT_Face Face, uint32_t SdfSize, FontGlyph* G) {
+    SdfGlyph Sdf;
+    MeasureSdf(Face, FT_Get_Char_Index(Face, G->Source), Sdf);
+    if (!Sdf.Exists) {
+      G->FillEmpty();
+      return;
+    }
+    auto Scale = (float) G->Size / SdfSize;
+    G->Advance = (uint32_t) lround(Sdf.Advance * Scale / 64);
+    if (!Sdf.NRow || !Sdf.NCol) {
+      auto Advance = G->Advance;
+      G->FillEmpty();
+      G->Advance = Advance;
+      return;
     }
+    size_t NRow, NCol;
+    SdfExtent(Sdf, Scale, G->BearX, G->BearY, NRow, NCol);
+    G->HasBmp = 2;
+    G->Mask.Resize(NRow, NCol);
+    G->Mask.Fill(0);
+  }
 
-private:
-    FontInfo                    mInfo;
-    std::vector<FontInfo *>     mFallbacks;
+  // Sharpens the coverage and builds the outline and shadow layers. The
+  // mask grows to hold them; the extra width goes to the advance.
+  void ApplyEffects(const GlyphEffects& Fx, FontGlyph* G) {
+    if (G->HasBmp != 2)
+      return;
+    Sharpen(G->Mask, Fx.Sharpen);
+    if (!Fx.Layered())
+      return;
+    auto R = (int32_t) Fx.Outline;
+    auto Left = R + max(0, -Fx.ShadowX);
+    auto Right = R + max(0, Fx.ShadowX);
+    auto Top = R + max(0, -Fx.ShadowY);
+    auto Bottom = R + max(0, Fx.ShadowY);
+    auto NRow = G->Mask.NRow() + Top + Bottom;
+    auto NCol = G->Mask.NCol() + Left + Right;
+    auto Place = [&](Coverage& Dst, const Coverage& Src, size_t Y, size_t X) {
+      Dst.Resize(NRow, NCol);
+      Dst.Fill(0);
+      for (auto i = size_t{0}; i < Src.NRow(); ++i)
+        copy(Src[i], Src[i] + Src.NCol(), Dst[i + Y] + X);
+    };
+    Coverage Ring;
+    if (R)
+      Dilate(G->Mask, R, Ring);
+    else
+      Ring = G->Mask;
+    if (R)
+      Place(G->Outline, Ring, Top - R, Left - R);
+    if (Fx.ShadowX || Fx.ShadowY)
+      Place(G->Shadow, Ring, Top - R + Fx.ShadowY, Left - R + Fx.ShadowX);
+    auto Body = move(G->Mask);
+    Place(G->Mask, Body, Top, Left);
+    G->BearY += Top;
+    G->Advance += Left + Right;
+  }
 
-};
+  // White glyphs without layers are copied as gray; others are blended
+  bool IsPlain(const FontGlyph* G) {
+    return !G->Outline.Count() && !G->Shadow.Count() && G->FgCol.Rgb() == 0xffffff;
+  }
 
-void Font::RenderGlyphsGDI(int size)
-{
-  vector<FontGlyph*> ToRender;
+  // Shadow, outline and body, back to front; Bmp must be clear unless the
+  // glyph is plain
+  void DrawGlyph(Bitmap& Bmp, const FontGlyph* G, const GlyphEffects& Fx, int32_t X, int32_t Y) {
+    if (IsPlain(G)) {
+      Bmp.DrawCoverage(G->Mask, X, Y);
+      return;
+    }
+    if (G->Shadow.Count())
+      Bmp.BlendCoverage(G->Shadow, Fx.ShadowCol, X, Y);
+    if (G->Outline.Count())
+      Bmp.BlendCoverage(G->Outline, Fx.OutlineCol, X, Y);
+    Bmp.BlendCoverage(G->Mask, G->FgCol, X, Y);
+  }
 
-  for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch) {
-      auto& G = Glyphs[Ch];
-      if (!G) {
-          continue;
-      }
-      Assert(G->Char == Ch);
-      if (G->HasBmp) {
-          continue;
-      }
-      ToRender.emplace_back(Glyphs[Ch].get());
+  void DropCoverage(FontGlyph* G) {
+    G->Mask = {};
+    G->Outline = {};
+    G->Shadow = {};
+  }
+
+  // Glyphs are rendered and laid out grouped by (face, size)
+  bool RenderOrder(const FontGlyph* A, const FontGlyph* B) {
+    return A->FaceIdx != B->FaceIdx ? A->FaceIdx < B->FaceIdx : A->Size < B->Size;
   }
-  string name = Faces[0];
-  wstring wName = wstring(name.begin(), name.end());
-  FontLoader loader;
-  if (!loader.load(wName.c_str())) {
-      Abort("Load %lS failed\n", wName.c_str());
+
+  // The line height of each glyph's own (face, size), so a small partition
+  // is not stretched to a larger one's; Sorted is in RenderOrder
+  vector<int> LineHeights(FtWorker& W, const vector<string>& Faces, const vector<FontGlyph*>& Sorted) {
+    vector<int> Heights(Sorted.size());
+    for (auto i = size_t{0}; i < Sorted.size(); ++i) {
+      auto G = Sorted[i];
+      if (i && G->FaceIdx == Sorted[i - 1]->FaceIdx && G->Size == Sorted[i - 1]->Size)
+        Heights[i] = Heights[i - 1];
+      else
+        Heights[i] = getFontHeight(W.Select(Faces, G->FaceIdx, G->Size), G->Size);
+    }
+    return Heights;
   }
-  FontInfoImpl impl(loader.logFont(), size);
-  printf("FONT height: %ld\n", impl.metric().tmHeight);
-
-  for (auto& G: ToRender) {
-      GLYPHMETRICS gm;
-      wchar_t c = ToSimple(G->Char);
-      bool ok = impl.getBitmap(c, G->Bmp, &gm);
-      if (!ok) {
-          if (c == 0x3000) {
-              Warn("A1A1 not found, generate default blank character");
-              ok = impl.getBitmap(0x7530, G->Bmp, &gm);
-              if (ok) {
-                  Warn("Generate a1 w %zd h %zd", G->Bmp.Width(), G->Bmp.Height());
-                  G->Bmp.Fill({});
-              }
-          }
-          if (!ok && (c >= 32 && c < 127)) {
-              ok = impl.getBitmap(L'.', G->Bmp, &gm);
-              if (ok) {
-                  Warn("Replace %u(0x%x) with space w %zd h %zd", c, c, G->Bmp.Width(), G->Bmp.Height());
-                  G->Bmp.Fill({});
-              }
-          }
-      }
-      if (!ok) {
-          Warn("No glyph found for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
-          fillEmpty(G);
-          continue;
-      }
-      //Warn("Char %lc %zd %zd", G->Char, G->Bmp.Width(), G->Bmp.Height());
-      G->BearX = gm.gmBlackBoxX;
-      G->BearY = gm.gmBlackBoxY;
-      G->HasBmp = 2;
-      G->Advance = gm.gmCellIncX;
+}
+
+void Font::MapSources(const vector<FontGlyph*>& ToRender) {
+  for (auto G : ToRender) {
+    G->Source = Simplify ? ToSimplified(G->Char) : G->Char;
+    G->Blank = false;
   }
+}
 
-  LnSpacing = impl.metric().tmHeight;
-  CapHeight = 1;
+void Font::PlanFaces(vector<FontGlyph*>& ToRender) {
+  for (auto Idx : Fallbacks)
+    if (Idx < 0 || (size_t) Idx >= Faces.size())
+      Abort("Fallback face index is out of range: %d (%zu faces)", Idx, Faces.size());
+  FT_Library Lib{};
+  FtAss(FT_Init_FreeType(&Lib));
+  vector<const CharSet*> Sets(Faces.size());
+  auto Covers = [&](int32_t Idx, uint16_t Ch) {
+    if (!Sets[Idx])
+      Sets[Idx] = &CharSetCache::Global().Get(Lib, Faces[Idx]);
+    return Sets[Idx]->test(Ch);
+  };
+  auto FindFace = [&](int32_t Own, uint16_t Ch) {
+    if (Covers(Own, Ch))
+      return Own;
+    for (auto Fb : Fallbacks)
+      if (Covers(Fb, Ch))
+        return Fb;
+    return -1;
+  };
+  CharSet Gaps;
+  auto NFallback = 0u;
+  auto NKept = size_t{0};
+  for (auto G : ToRender) {
+    auto Idx = FindFace(G->FaceIdx, G->Source);
+    // Same substitutions as the GDI path: a blank ideographic space sized
+    // like U+7530, and blank printable ASCII sized like '.'
+    if (Idx < 0 && G->Source == 0x3000 && (Idx = FindFace(G->FaceIdx, 0x7530)) >= 0) {
+      Warn("U+3000 not found, generate default blank character");
+      G->Source = 0x7530;
+      G->Blank = true;
+    }
+    if (Idx < 0 && G->Source >= 32 && G->Source < 127 && (Idx = FindFace(G->FaceIdx, '.')) >= 0) {
+      Warn("Replace %u(0x%x) with space", G->Source, G->Source);
+      G->Source = '.';
+      G->Blank = true;
+    }
+    if (Idx < 0) {
+      Gaps.set(G->Source);
+      G->FillEmpty();
+      continue;
+    }
+    if (Idx != G->FaceIdx) {
+      G->FaceIdx = Idx;
+      ++NFallback;
+    }
+    ToRender[NKept++] = G;
+  }
+  ToRender.resize(NKept);
+  FtAss(FT_Done_FreeType(Lib));
+  if (NFallback)
+    Warn("%u chars are rendered with fallback faces", NFallback);
+  if (Gaps.any())
+    Warn("No glyph found for %zu chars, dummy (1x1) bitmaps will be generated: %s",
+      Gaps.count(), Gaps.Format().c_str());
 }
 
 void Font::RenderGlyphs() {
+  BuildGlyphs(true);
+}
+
+FontMetrics Font::MeasureGlyphs() {
+  vector<pair<FontGlyph*, FontGlyph>> Saved;
+  for (auto& G : Glyphs)
+    if (G && !G->HasBmp)
+      Saved.emplace_back(G.get(), *G);
+  auto M = BuildGlyphs(false);
+  for (auto& [G, Old] : Saved)
+    *G = move(Old);
+  return M;
+}
+
+uint32_t Font::FitSize(uint32_t Spacing, uint32_t Lo, uint32_t Hi) {
+  auto OldSpacing = LnSpacing;
+  LnSpacing = Spacing;
+  // Coverage does not depend on the size, so faces are planned, and gaps
+  // reported, once rather than for every size probed
+  auto Planned = PlanGlyphs();
+  auto Fits = [&](uint32_t Sz) {
+    vector<FontGlyph> Saved;
+    for (auto G : Planned) {
+      G->Size = Sz;
+      Saved.push_back(*G);
+    }
+    auto M = BuildPlanned(Planned, false);
+    for (auto i = size_t{0}; i < Planned.size(); ++i)
+      *Planned[i] = move(Saved[i]);
+    return M.LnSpacing <= Spacing && M.MaxH <= M.ActualSpacing;
+  };
+  if (!Fits(Lo))
+    Warn("No size in [%u, %u] fits line spacing %u, using %u", Lo, Hi, Spacing, Lo);
+  else
+    while (Lo < Hi) {
+      auto Mid = Lo + (Hi - Lo + 1) / 2;
+      if (Fits(Mid))
+        Lo = Mid;
+      else
+        Hi = Mid - 1;
+    }
+  for (auto& G : Glyphs)
+    if (G && !G->HasBmp)
+      G->Size = Lo;
+  Size = Lo;
+  LnSpacing = OldSpacing;
+  return Lo;
+}
+
+vector<FontGlyph*> Font::PlanGlyphs() {
   vector<FontGlyph*> ToRender;
 
   for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch) {
@@ -321,131 +603,129 @@ void Font::RenderGlyphs() {
       Abort("The size of char (%u) should not be 0", Ch);
     ToRender.emplace_back(Glyphs[Ch].get());
   }
-  sort(ToRender.begin(), ToRender.end(),
-    [](FontGlyph* A, FontGlyph* B) {
-      return A->FaceIdx != B->FaceIdx ? A->FaceIdx < B->FaceIdx : A->Size < B->Size;
-    }
-  );
-  int32_t LastFace{-1};
-  uint32_t LastSize{};
-  FT_Library Lib{};
-  FtAss(FT_Init_FreeType(&Lib));
-  FT_Face Face{};
-  for (auto& G : ToRender) {
-    if (G->FaceIdx != LastFace) {
-      if (Face)
-        FtAss(FT_Done_Face(Face));
-      FtAss(FT_New_Face(Lib, Faces[G->FaceIdx].c_str(), 0, &Face));
-      LastFace = G->FaceIdx;
-      LastSize = 0;
-    }
-    if (G->Size != LastSize) {
-      FtAss(FT_Set_Pixel_Sizes(Face, 0, G->Size));
-      LastSize = G->Size;
-    }
-    auto FtgIdx = FT_Get_Char_Index(Face, G->Char);
-    if (!FtgIdx) {
-      Warn("No glyph found for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
-      G->Valid = false;
-      G->BearX = 0;
-      G->BearY = 1;
-      G->Advance = 1;
-      G->HasBmp = 1;
-      G->Bmp.Resize(1, 1);
-      G->Bmp.Fill({});
+  MapSources(ToRender);
+  PlanFaces(ToRender);
+  return ToRender;
+}
+
+FontMetrics Font::BuildGlyphs(bool Raster) {
+  return BuildPlanned(PlanGlyphs(), Raster);
+}
+
+FontMetrics Font::BuildPlanned(vector<FontGlyph*> ToRender, bool Raster) {
+  FontMetrics M;
+  sort(ToRender.begin(), ToRender.end(), RenderOrder);
+  if (ToRender.empty())
+    return M;
+  auto NSlot = NThread ? (size_t) NThread : ThreadPool::DefaultThreads();
+  vector<FtWorker> Workers(NSlot);
+  // Cache keys name faces by file content, not by path
+  vector<pair<uint64_t, int32_t>> FaceKeys;
+  if (Raster && Cache)
+    for (auto& Spec : Faces) {
+      auto [Path, Index] = ParseFaceSpec(Spec);
+      FaceKeys.emplace_back(FaceCache::Global().Load(Path).Hash, (int32_t) Index);
     }
-    else {
-      FtAss(FT_Load_Glyph(Face, FtgIdx, G->AntiAliasing ? FT_LOAD_DEFAULT : FT_LOAD_TARGET_MONO | FT_LOAD_MONOCHROME));
-      if (Face->glyph->format != FT_GLYPH_FORMAT_BITMAP)
-        FtAss( FT_Render_Glyph(Face->glyph, G->AntiAliasing ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO));
-      auto& Ftg = Face->glyph;
-      auto& Ftb = Face->glyph->bitmap;
-      auto& metrics = Face->glyph->metrics;
-      if (!Ftb.width || !Ftb.rows) {
-        Warn("Empty bitmap generated for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
-        G->Valid = false;
-        G->BearX = 0;
-        G->BearY = 1;
-        G->Advance = Ftg->advance.x >> 6;
-        G->HasBmp = 1;
-        G->Bmp.Resize(1, 1);
-        G->Bmp.Fill({});
-      }
-      else {
-        dumpGlyphy(G->Char, Face, Ftg, G->Size);
-        G->BearX = Ftg->bitmap_left;
-        G->BearY = Ftg->bitmap_top;
-        G->Advance = Ftg->advance.x >> 6;
-        G->HasBmp = 2;
-        G->Bmp.Resize(Ftb.width, Ftb.rows);
-        if (G->AntiAliasing) {
-          for (auto i = 0u; i < Ftb.rows; ++i)
-            for (auto j = 0u; j < Ftb.width; ++j) {
-              auto Col = Ftb.buffer[i * Ftb.pitch + j];
-              G->Bmp[i][j].R = Col;
-              G->Bmp[i][j].G = Col;
-              G->Bmp[i][j].B = Col;
-#ifdef BMP_ALPHA
-              G->Bmp[i][j].A = Col ? 255 : 0;
-#endif
-            }
-        }
+  MemPhase Rasterize("rasterize");
+  ThreadPool::Global().ParallelFor(ToRender.size(), RenderChunk,
+    [&](size_t Beg, size_t End, size_t Slot) {
+      auto& W = Workers[Slot];
+      auto Lut = Gamma ? CoverageGamma : nullptr;
+      for (auto i = Beg; i < End; ++i) {
+        auto G = ToRender[i];
+        if (!Raster && SdfSize)
+          MeasureSdfGlyph(W.Select(Faces, G->FaceIdx, SdfSize), SdfSize, G);
+        else if (!Raster)
+          MeasureGlyph(W.Select(Faces, G->FaceIdx, G->Size), G);
         else {
-          for (auto i = 0u; i < Ftb.rows; ++i)
-            for (auto j = 0u; j < Ftb.width; ++j) {
-              auto Col = Ftb.buffer[i * Ftb.pitch + (j >> 3)] & (1u << ((j & 7) ^ 7));
-              G->Bmp[i][j].R = Col ? 255 : 0;
-              G->Bmp[i][j].G = Col ? 255 : 0;
-              G->Bmp[i][j].B = Col ? 255 : 0;
-#ifdef BMP_ALPHA
-              G->Bmp[i][j].A = Col ? 255 : 0;
-#endif
-            }
+          GlyphKey Key;
+          auto Hit = false;
+          if (Cache) {
+            auto& [Hash, Index] = FaceKeys[G->FaceIdx];
+            Key = GlyphKey::Make(Hash, Index, SdfSize, Gamma, G);
+            Hit = Cache->Find(Key, G);
+          }
+          if (!Hit && SdfSize)
+            RenderSdfGlyph(W.Select(Faces, G->FaceIdx, SdfSize), Faces[G->FaceIdx], SdfSize, G, Lut);
+          else if (!Hit)
+            RenderGlyph(W.Select(Faces, G->FaceIdx, G->Size), G, Lut);
+          if (Cache && !Hit)
+            Cache->Put(Key, G);
         }
+        if (!Effects.Empty())
+          ApplyEffects(Effects, G);
       }
-    }
-  }
-  if (Face)
-    FtAss(FT_Done_Face(Face));
-  FtAss(FT_Done_FreeType(Lib));
+    },
+    NSlot
+  );
+  auto FontHeights = LineHeights(Workers[0], Faces, ToRender);
+  Workers.clear();
+  return PadGlyphs(ToRender, FontHeights, Raster);
+}
+
+FontMetrics Font::Relayout() {
+  vector<FontGlyph*> ToLay;
+  for (auto& G : Glyphs)
+    if (G && G->HasBmp == 2 && G->Mask.Count())
+      ToLay.push_back(G.get());
+  sort(ToLay.begin(), ToLay.end(), RenderOrder);
+  FtWorker W;
+  return PadGlyphs(ToLay, LineHeights(W, Faces, ToLay), true);
+}
+
+FontMetrics Font::PadGlyphs(const vector<FontGlyph*>& ToRender, const vector<int>& FontHeights, bool Raster) {
+  FontMetrics M;
   auto MaxDescent = int32_t{};
   for (auto& G : ToRender)
     if (G->HasBmp == 2)
       MaxDescent = max(MaxDescent, G->Descent());
   auto MaxPadding = ~DescentPadding ? DescentPadding : MaxDescent + OriginOffset + DescentOffset;
   auto MaxH = size_t{};
-  printf("LastSize: %d\n", LastSize);
-  auto fontHeight = getFontHeight(Face, LastSize);
 
+  // Glyphs are re-allocated at their padded size here, and their coverage
+  // layers are dropped once drawn unless KeepGlyphs is set
+  MemPhase Pad("layout");
+
+  // Per-glyph warnings are left to the real render
   std::map<int, int> heightCount;
-  for (auto& G : ToRender) {
+  vector<size_t> Heights(ToRender.size());
+  for (auto i = size_t{0}; i < ToRender.size(); ++i) {
+    auto G = ToRender[i];
     if (G->HasBmp != 2)
       continue;
     if (G->BearX < 0) {
-      Warn("BearX is negative (%d) for char (%u), set it to 0", G->BearX, G->Char);
+      if (Raster)
+        Warn("BearX is negative (%d) for char (%u), set it to 0", G->BearX, G->Char);
       G->BearX = 0;
     }
     if (G->BearX || G->Descent() != MaxPadding) {
-      auto W = G->BearX + (int32_t) G->Bmp.Width();
-      auto H = fontHeight;
+      auto W = G->BearX + (int32_t) G->Mask.NCol();
+      auto H = FontHeights[i];
       if (W <= 0 || H <= 0) {
-        Warn("The bitmap of char (%u) is completely cropped out, a dummy (1x1) bitmap will be generated", G->Char);
+        if (Raster)
+          Warn("The bitmap of char (%u) is completely cropped out, a dummy (1x1) bitmap will be generated", G->Char);
         G->HasBmp = 1;
         G->Bmp.Resize(1, 1);
         G->Bmp.Fill({});
         continue;
       }
-      auto Bmp = Bitmap(W, H);
-      Bmp.Fill({});
+      Heights[i] = H;
+      if (!Raster)
+        continue;
       //int offsetY = MaxPadding + G->BearY - G->Bmp.Height();
-      int offsetY = fontHeight - G->BearY - MaxPadding;
+      int offsetY = H - G->BearY - MaxPadding;
       if (G->Char == L'e' || G->Char == L'l') {
           printf("Char 0x%x W: %d, H: %d, X: %d, Y: %d, bmW: %zd, bmH: %zd\n",
                  G->Char,
-                 W, H, G->BearX, offsetY, G->Bmp.Width(), G->Bmp.Height());
+                 W, H, G->BearX, offsetY, G->Mask.NCol(), G->Mask.NRow());
       }
-      Bmp.Draw(G->Bmp, G->BearX, offsetY);
-      // auto height = shrink(Bmp);
+      // The coverage goes straight to its padded position
+      G->Bmp.Resize(W, H);
+      G->Bmp.Fill({});
+      DrawGlyph(G->Bmp, G, Effects, G->BearX, offsetY);
+      if (!KeepGlyphs)
+        DropCoverage(G);
+      // auto height = shrink(G->Bmp);
       // if (height == 0) {
       //   Warn("The bitmap of char (%u) is shrinked out, a dummy (1x1) bitmap will be generated", G->Char);
       //   G->HasBmp = 1;
@@ -453,40 +733,77 @@ void Font::RenderGlyphs() {
       //   G->Bmp.Fill({});
       //   continue;
       // }
-      G->Bmp = move(Bmp);
     }
-    heightCount[(int)G->Bmp.Height()] += 1;
-    MaxH = max(MaxH, G->Bmp.Height());
+    else {
+      Heights[i] = G->Mask.NRow();
+      if (!Raster)
+        continue;
+      G->Bmp.Resize(G->Mask.NCol(), G->Mask.NRow());
+      if (!IsPlain(G))
+        G->Bmp.Fill({});
+      DrawGlyph(G->Bmp, G, Effects, 0, 0);
+      if (!KeepGlyphs)
+        DropCoverage(G);
+    }
   }
-  auto ptr = std::max_element(heightCount.begin(), heightCount.end(), [](const auto& x, const auto &y) {
-      return x.second < y.second;
-  });
-  auto mostH = ptr->first;
-  auto count = ptr->second;
-  if ((int)MaxH != mostH) {
-      Warn("Update MAXH: %zd, mostH: %d (%d)\n", MaxH, mostH, count);
-      MaxH = mostH;
-      // for (auto& G: ToRender) {
-      //     if (G->Bmp.Height() > MaxH) {
-      //         auto oH = G->Bmp.Height();
-      //         G->Bmp.Shrink(MaxH);
-      //         Warn("Shrink (%u) from %zd to %zd", G->Char, oH, G->Bmp.Height());
-      //     }
-      // }
+  for (auto H : Heights)
+    if (H) {
+      heightCount[(int)H] += 1;
+      MaxH = max(MaxH, H);
+    }
+  // Without any drawn glyph MaxH stays 0, but the line spacing and cap
+  // height are still set from the config below
+  if (!heightCount.empty()) {
+    auto ptr = std::max_element(heightCount.begin(), heightCount.end(), [](const auto& x, const auto &y) {
+        return x.second < y.second;
+    });
+    auto mostH = ptr->first;
+    auto count = ptr->second;
+    if ((int)MaxH != mostH) {
+        if (Raster)
+          Warn("Update MAXH: %zd, mostH: %d (%d)\n", MaxH, mostH, count);
+        MaxH = mostH;
+        // for (auto& G: ToRender) {
+        //     if (G->Bmp.Height() > MaxH) {
+        //         auto oH = G->Bmp.Height();
+        //         G->Bmp.Shrink(MaxH);
+        //         Warn("Shrink (%u) from %zd to %zd", G->Char, oH, G->Bmp.Height());
+        //     }
+        // }
+    }
   }
-  if (!LnSpacing)
-    LnSpacing = (uint32_t)(ceil((float)(MaxH - MaxDescent * 10 / HeightConstant)) + LnSpacingOff);
-  auto ActualSpacing = HeightConstant * LnSpacing / 10;
-  if (ActualSpacing < MaxH)
-    Warn("The maximum height (%zu) of newly generated glyphs is larger than Actual Spacing (%u)", MaxH, ActualSpacing);
-  if (!CapHeight)
-    CapHeight = 1; // CapHeightOff + (Size / 2);
+  M.MaxDescent = MaxDescent;
+  M.MaxH = MaxH;
+  M.LnSpacing = (uint32_t) max(ceil((float) ((int64_t) MaxH - MaxDescent * 10 / HeightConstant)) + LnSpacingOff, 0.f);
+  auto Spacing = LnSpacing ? LnSpacing : M.LnSpacing;
+  M.ActualSpacing = HeightConstant * Spacing / 10;
+  if (M.ActualSpacing < MaxH && Raster)
+    Warn("The maximum height (%zu) of newly generated glyphs is larger than Actual Spacing (%u)", MaxH, M.ActualSpacing);
+  for (auto i = size_t{0}; i < ToRender.size(); ++i)
+    if (Heights[i] > M.ActualSpacing)
+      M.Overflow.push_back(ToRender[i]->Char);
+  sort(M.Overflow.begin(), M.Overflow.end());
+  M.CapHeight = CapHeight ? CapHeight : 1; // CapHeightOff + (Size / 2);
+  if (!Raster)
+    return M;
+  LnSpacing = Spacing;
+  CapHeight = M.CapHeight;
 
   printf("MaxH %zd MaxDescent %d HeightConstant %d LnSpacingOff %d\n",
          MaxH, MaxDescent, HeightConstant, LnSpacing);
+  return M;
 }
 
-pair<size_t, size_t> Font::Extent(wstring_view Str) {
+const FontGlyph* Font::Lookup(wchar_t Ch, vector<wchar_t>* Missing) const {
+  if ((size_t) Ch < Glyphs.size() && Glyphs[Ch] && Glyphs[Ch]->HasBmp)
+    return Glyphs[Ch].get();
+  if (Missing)
+    Missing->push_back(Ch);
+  auto& G = Glyphs[FallbackChar];
+  return G && G->HasBmp ? G.get() : nullptr;
+}
+
+pair<size_t, size_t> Font::Extent(wstring_view Str, vector<wchar_t>* Missing) {
   auto NLine = (uint32_t) count(Str.begin(), Str.end(), L'\n') + 1;
   auto W = size_t{0};
   auto H = size_t{NLine * LnSpacing};
@@ -502,9 +819,9 @@ pair<size_t, size_t> Font::Extent(wstring_view Str) {
       X = 0u;
       continue;
     }
-    auto& G = Glyphs[Ch];
-    if (!G->HasBmp)
-      Abort("No bitmap for char (%d)", (int) Ch);
+    auto G = Lookup(Ch, Missing);
+    if (!G)
+      continue;
     H = max(H, HCur + G->Bmp.Height());
     XMax = max(XMax, X + G->BearX + G->Bmp.Width());
     X += G->Advance;
@@ -513,26 +830,143 @@ pair<size_t, size_t> Font::Extent(wstring_view Str) {
   return {W, H};
 }
 
-Bitmap Font::Render(wstring_view Str) {
-  auto [W, H] = Extent(Str);
+Bitmap Font::Render(wstring_view Str, vector<wchar_t>* Missing) {
+  Bitmap Bmp;
+  RenderInto(Bmp, Str, Missing);
+  return Bmp;
+}
+
+void Font::RenderInto(Bitmap& Canvas, wstring_view Str, vector<wchar_t>* Missing) {
+  auto [W, H] = Extent(Str, Missing);
   auto NLine_ = (int32_t) count(Str.begin(), Str.end(), L'\n');
   auto X = (int32_t) 0;
   auto Y = (int32_t) (H - NLine_ * LnSpacing);
-  Bitmap Bmp(W, H);
-  Bmp.Fill({});
+  Canvas.Resize(W, H);
+  Canvas.Fill({});
   for (auto Ch : Str) {
     if (Ch == L'\n') {
       X = 0u;
       Y += LnSpacing;
       continue;
     }
-    auto& G = Glyphs[Ch];
-    if (!G->HasBmp)
-      Abort("No bitmap for char (%d)", (int) Ch);
-    Bmp.Draw(G->Bmp, X + G->BearX, Y - G->BearY);
+    auto G = Lookup(Ch, nullptr);
+    if (!G)
+      continue;
+    Canvas.Draw(G->Bmp, X + G->BearX, Y - G->BearY);
     X += G->Advance;
   }
-  return Bmp;
+}
+
+pair<size_t, size_t> Font::PlaceText(wstring_view Str, vector<Placed>& Out, vector<wchar_t>* Missing,
+  const TextColors* Colors) const {
+  // Tops are relative to the first baseline, which is only known once every
+  // line's height is (see Extent)
+  Out.clear();
+  auto NLine = (int32_t) count(Str.begin(), Str.end(), L'\n') + 1;
+  auto Line = int32_t{0};
+  auto X = int32_t{0};
+  auto W = size_t{0};
+  auto H = (size_t) NLine * LnSpacing;
+  auto Lut = (const uint8_t*) nullptr;
+  for (auto i = size_t{0}; i < Str.size(); ++i) {
+    auto Ch = Str[i];
+    if (Ch == L'\n') {
+      ++Line;
+      X = 0;
+      continue;
+    }
+    if (Colors && TextColors::CodeLen(Str.substr(i))) {
+      if (auto Sel = Colors->Lut(Str[i + 2]))
+        Lut = Sel;
+      i += TextColors::CodeLen(Str.substr(i)) - 1;
+      continue;
+    }
+    auto G = Lookup(Ch, Missing);
+    if (!G)
+      continue;
+    Out.push_back({G, X + G->BearX, Line * (int32_t) LnSpacing - G->BearY, Lut});
+    H = max(H, (size_t) ((NLine - 1 - Line) * (int32_t) LnSpacing) + G->Bmp.Height());
+    W = max(W, (size_t) (X + G->BearX) + G->Bmp.Width());
+    X += G->Advance;
+  }
+  auto Base = (int32_t) H - (NLine - 1) * (int32_t) LnSpacing;
+  for (auto& P : Out)
+    P.Y += Base;
+  return {W, H};
+}
+
+bool Font::RenderBands(wstring_view Str, const char* Path, vector<wchar_t>* Missing, size_t BandH) {
+  vector<Placed> Glyphs_;
+  auto [W, H] = PlaceText(Str, Glyphs_, Missing, nullptr);
+  if (!W || !H) {
+    Warn("Nothing to render to %s", Path);
+    return false;
+  }
+  auto NBand = (H + BandH - 1) / BandH;
+  vector<vector<uint32_t>> Bands(NBand);
+  for (auto i = size_t{0}; i < Glyphs_.size(); ++i) {
+    auto& P = Glyphs_[i];
+    if (!P.G->Bmp.Height())
+      continue;
+    auto First = (size_t) max(P.Y, 0) / BandH;
+    auto Last = min((size_t) max(P.Y + (int32_t) P.G->Bmp.Height() - 1, 0) / BandH, NBand - 1);
+    for (auto b = First; b <= Last; ++b)
+      Bands[b].push_back((uint32_t) i);
+  }
+  // A wave of one band per thread is drawn in parallel, then written in order
+  auto& Pool = ThreadPool::Global();
+  vector<Bitmap> Canvases(Pool.NThread());
+  PngWriter Out(Path, W, H);
+  for (auto First = size_t{0}; First < NBand; First += Canvases.size()) {
+    auto N = min(Canvases.size(), NBand - First);
+    Pool.ParallelFor(N, 1,
+      [&](size_t Beg, size_t End, size_t) {
+        for (auto i = Beg; i < End; ++i) {
+          auto b = First + i;
+          auto& Canvas = Canvases[i];
+          Canvas.Resize(W, min(BandH, H - b * BandH));
+          Canvas.Fill({});
+          for (auto Idx : Bands[b]) {
+            auto& P = Glyphs_[Idx];
+            Canvas.DrawBand(P.G->Bmp, P.X, P.Y - (int32_t) (b * BandH));
+          }
+        }
+      }
+    );
+    for (auto i = size_t{0}; i < N; ++i)
+      Out.WriteRows(Canvases[i], Canvases[i].Height());
+  }
+  return true;
+}
+
+IndexedBitmap Font::RenderIndexed(wstring_view Str, const TextColors& Colors, vector<wchar_t>* Missing) {
+  vector<Placed> Glyphs_;
+  auto [W, H] = PlaceText(Str, Glyphs_, Missing, &Colors);
+  IndexedBitmap Canvas(W, H);
+  Canvas.Fill(0);
+  for (auto& P : Glyphs_) {
+    if (P.G->Bmp.Count() && !P.G->Idx.Count())
+      Abort("Char %u has no palette indices; the font should be read from an IndexedSprite", P.G->Char);
+    Canvas.Draw(P.G->Idx, P.X, P.Y, P.Lut);
+  }
+  return Canvas;
+}
+
+void Font::RenderBatch(const vector<wstring>& Strs, const TextSink& Out) {
+  auto& Pool = ThreadPool::Global();
+  vector<Bitmap> Canvases(Pool.NThread());
+  Pool.ParallelFor(Strs.size(), 16,
+    [&](size_t Beg, size_t End, size_t Slot) {
+      vector<wchar_t> Missing;
+      for (auto i = Beg; i < End; ++i) {
+        Missing.clear();
+        RenderInto(Canvases[Slot], Strs[i], &Missing);
+        sort(Missing.begin(), Missing.end());
+        Missing.erase(unique(Missing.begin(), Missing.end()), Missing.end());
+        Out(i, Canvases[Slot], Missing);
+      }
+    }
+  );
 }
 
 void Font::Dump(Sprite& Spr, FontTable& Tbl) {
@@ -564,7 +998,10 @@ void Font::Dump(Sprite& Spr, FontTable& Tbl) {
       C.Dc6Index = G->Valid == true ? (uint16_t) Id : (uint16_t) 0;
       C.ZPad1 = 0;
       C.ZPad2 = 0;
-      Spr[0][Id] = move(G->Bmp);
+      if (KeepGlyphs)
+        Spr[0][Id] = G->Bmp;
+      else
+        Spr[0][Id] = move(G->Bmp);
       ++Id;
     }
   Assert(Id == NChar);
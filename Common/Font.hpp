@@ -2,13 +2,21 @@
 
 #include "Common.hpp"
 
+#include <functional>
+
 #include "Bitmap.hpp"
+#include "Effects.hpp"
 #include "FontTable.hpp"
 #include "Sprite.hpp"
+#include "TextColor.hpp"
+
+class GlyphCache;
 
 struct FontGlyph {
   // In, not used by TBL/DC6
   uint16_t    Char{};
+  uint16_t    Source{}; // codepoint actually rendered, see Font::MapSources
+  bool        Blank{false}; // keep the metrics of Source but draw nothing
   bool        AntiAliasing{true};
   int32_t     FaceIdx{-1}; // -1: no face
   uint32_t    Size{0};
@@ -21,11 +29,29 @@ struct FontGlyph {
   int32_t     BearX{};
   int32_t     BearY{};
   uint32_t    Advance{};
+  Coverage    Mask{}; // rasterizer output, laid out into Bmp
+  Coverage    Outline{}; // effect layers, empty or the same size as Mask
+  Coverage    Shadow{};
   Bitmap      Bmp{};
+  IndexedBitmap Idx{}; // palette indices of Bmp, if read from an IndexedSprite
 
   bool        Valid{ true }; // valid glyph
 
-  constexpr int32_t Descent() { return (int32_t) Bmp.Height() - BearY; }
+  // Marks the glyph as missing, with a blank 1x1 bitmap
+  void FillEmpty();
+  constexpr int32_t Descent() { return (int32_t) (Mask.Count() ? Mask.NRow() : Bmp.Height()) - BearY; }
+};
+
+class CompiledFont;
+
+// Line metrics of a laid out font, see Font::MeasureGlyphs
+struct FontMetrics {
+  int32_t MaxDescent{};
+  size_t MaxH{};              // the most common glyph height
+  uint32_t LnSpacing{};       // as computed from the glyphs, ignoring Font::LnSpacing
+  uint32_t CapHeight{};
+  uint32_t ActualSpacing{};   // HeightConstant * line spacing / 10
+  vector<uint16_t> Overflow{}; // chars taller than ActualSpacing
 };
 
 struct Font {
@@ -33,6 +59,7 @@ struct Font {
   // By Config
   vector<Palette> Pals{};
   vector<string> Faces{};
+  vector<int32_t> Fallbacks{}; // face indices tried when a glyph's own face lacks it
   uint32_t Size{};          // The first entry
   int32_t LnSpacingOff{0};
   int32_t CapHeightOff{0};
@@ -44,15 +71,96 @@ struct Font {
   uint32_t LnSpacing{};
   uint32_t CapHeight{};
   uint16_t UnkHZ{};
+  // Render workers for RenderGlyphs; 0 uses every core
+  uint32_t NThread{1};
+  // Render traditional Chinese chars with their simplified glyphs
+  bool Simplify{false};
+  // Apply the 1/2.2 gamma curve of the GDI path to FreeType coverage
+  bool Gamma{false};
+  // Non-zero: RenderGlyphs resamples every size from a signed distance field
+  // rendered once at this size, see SdfCache
+  uint32_t SdfSize{0};
+  // Applied by RenderGlyphs to every rendered glyph
+  GlyphEffects Effects{};
+  // Consulted by RenderGlyphs before rasterizing, and given what it renders
+  GlyphCache* Cache{nullptr};
+  // Drawn by Extent and Render in place of chars without a bitmap
+  uint16_t FallbackChar{'?'};
+  // Keep the coverage of rendered glyphs after layout, and their bitmaps
+  // after Dump, so that Relayout and Dump can run again
+  bool KeepGlyphs{false};
 
   void Clear();
   void FromSprTbl(Sprite& Spr, FontTable& Tbl);
+  // Also keeps the indices, for RenderIndexed
+  void FromSprTbl(IndexedSprite& Spr, FontTable& Tbl, const Palette& Pal);
+  // Borrows the bitmaps of Cf, which has to stay open while the font is used
+  void FromCompiled(const CompiledFont& Cf);
   //void ReadYml(const char* Path);
 
+  // Picks the codepoint each glyph is rendered from
+  void MapSources(const vector<FontGlyph*>& ToRender);
+  // Moves glyphs to the first face that covers them; drops uncovered ones
+  void PlanFaces(vector<FontGlyph*>& ToRender);
   void RenderGlyphs();
+  // Lays out the pending glyphs from their metrics alone and returns what
+  // RenderGlyphs would compute; the glyphs are left unrendered
+  FontMetrics MeasureGlyphs();
+  // Largest size in [Lo, Hi] whose glyphs fit line spacing Spacing (see
+  // MeasureGlyphs); it becomes Size and the size of every pending glyph
+  uint32_t FitSize(uint32_t Spacing, uint32_t Lo, uint32_t Hi);
+  // Rasterizes, or only measures, the pending glyphs and lays them out
+  FontMetrics BuildGlyphs(bool Raster);
+  // Lays out again the glyphs rendered with KeepGlyphs, after padding or
+  // line spacing settings changed; nothing is rasterized. As in
+  // BuildGlyphs, a non-zero LnSpacing is kept rather than recomputed.
+  FontMetrics Relayout();
+#ifdef _WIN32
+  // Renders through GDI, see FontGdi.cpp
   void RenderGlyphsGDI(int size);
+#endif
   void Dump(Sprite& Spr, FontTable& Tbl);
 
-  pair<size_t, size_t> Extent(wstring_view Str);
-  Bitmap Render(wstring_view Str);
+  // Chars without a bitmap are drawn as FallbackChar (or skipped if it has
+  // none either) and, if Missing is given, appended to it
+  pair<size_t, size_t> Extent(wstring_view Str, vector<wchar_t>* Missing = nullptr);
+  Bitmap Render(wstring_view Str, vector<wchar_t>* Missing = nullptr);
+  // Same as Render, reusing the storage of Canvas
+  void RenderInto(Bitmap& Canvas, wstring_view Str, vector<wchar_t>* Missing = nullptr);
+
+  // Same as Render, but the PNG at Path is rendered BandH rows at a time,
+  // bands in parallel, and streamed out; memory stays bounded by the band
+  // size however long Str is. False if there is nothing to draw.
+  bool RenderBands(wstring_view Str, const char* Path, vector<wchar_t>* Missing = nullptr, size_t BandH = 256);
+
+  // Same as Render, but in the palette indices of a font read from an
+  // IndexedSprite, with "ÿc" color codes recoloring the text that follows
+  IndexedBitmap RenderIndexed(wstring_view Str, const TextColors& Colors, vector<wchar_t>* Missing = nullptr);
+
+  // Sees each rendered string with its sorted missing chars; Bmp is reused
+  // once Out returns
+  using TextSink = function<void(size_t Idx, const Bitmap& Bmp, const vector<wchar_t>& Missing)>;
+  // Renders every string on the thread pool, into one canvas per thread
+  void RenderBatch(const vector<wstring>& Strs, const TextSink& Out);
+private:
+  struct Placed {
+    const FontGlyph* G;
+    int32_t X;
+    int32_t Y;
+    const uint8_t* Lut; // color in effect, see RenderIndexed
+  };
+
+  // The pending glyphs, with their sources mapped and faces planned; the
+  // chars no face covers are left as 1x1 dummies
+  vector<FontGlyph*> PlanGlyphs();
+  // Rasterizes, or only measures, planned glyphs and lays them out
+  FontMetrics BuildPlanned(vector<FontGlyph*> ToRender, bool Raster);
+  // Pads the rasterized glyphs, sorted by (face, size), to their line
+  // heights and sets the line metrics
+  FontMetrics PadGlyphs(const vector<FontGlyph*>& ToRender, const vector<int>& FontHeights, bool Raster);
+  const FontGlyph* Lookup(wchar_t Ch, vector<wchar_t>* Missing) const;
+  // Positions every glyph of Str on a canvas of the returned size; color
+  // codes are only recognized given Colors
+  pair<size_t, size_t> PlaceText(wstring_view Str, vector<Placed>& Out, vector<wchar_t>* Missing,
+    const TextColors* Colors) const;
 };
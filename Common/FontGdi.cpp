@@ -0,0 +1,169 @@
+#ifdef _WIN32
+#include <windows.h>
+#include "Font.hpp"
+
+#include "CharSet.hpp"
+#include "FaceCache.hpp"
+#include "FontLoader.hpp"
+
+class FontInfoImpl {
+public:
+    FontInfoImpl(const LOGFONTW& lf, int size):
+        mInfo(lf, size)
+    {
+        const wchar_t * fallbackNames[] = { L"Microsoft Sans Serif", L"Microsoft YaHei UI" };
+        mKnown = loadSet(mInfo, mSet, lf.lfFaceName);
+        for (auto name: fallbackNames) {
+            mFallbacks.push_back(new FontInfo(name, size));
+            mFallbackSets.emplace_back();
+            mFallbackKnown.push_back(loadSet(*mFallbacks.back(), mFallbackSets.back(), name));
+        }
+    }
+
+    ~FontInfoImpl()
+    {
+        for (auto fallbacks: mFallbacks) {
+            delete fallbacks;
+        }
+    }
+
+    const TEXTMETRIC& metric() { return mInfo.metric(); }
+
+    bool covers(wchar_t c)
+    {
+        if (has(c)) {
+            return true;
+        }
+        for (size_t i = 0; i < mFallbacks.size(); i += 1) {
+            if (hasFallback(i, c)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Only fonts whose cmap has c are asked for a bitmap
+    bool getBitmap(wchar_t c, Bitmap& bitmap, GLYPHMETRICS * metrics=nullptr)
+    {
+        bool ok = false;
+
+        if (has(c)) {
+            ok = mInfo.getBitmap(c, bitmap, metrics);
+            if (ok) {
+                return true;
+            }
+        }
+        for (size_t i = 0; i < mFallbacks.size(); i += 1) {
+            if (!hasFallback(i, c)) {
+                continue;
+            }
+            ok = mFallbacks[i]->getBitmap(c, bitmap, metrics);
+            if (ok) {
+                Warn("Replace char %u(0x%x) with fallback", c, c);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // An empty set means GDI could not tell the ranges, not that the font
+    // has no glyphs
+    static bool loadSet(FontInfo& info, CharSet& set, const wchar_t * name)
+    {
+        if (info.charSet(set)) {
+            return true;
+        }
+        Warn("No Unicode ranges for font (%ls), probing its glyphs one by one", name);
+        return false;
+    }
+
+    bool has(wchar_t c) { return mKnown ? mSet.test(c) : mInfo.hasGlyph(c); }
+
+    bool hasFallback(size_t i, wchar_t c)
+    {
+        return mFallbackKnown[i] ? mFallbackSets[i].test(c) : mFallbacks[i]->hasGlyph(c);
+    }
+
+private:
+    FontInfo                    mInfo;
+    CharSet                     mSet;
+    bool                        mKnown;
+    std::vector<FontInfo *>     mFallbacks;
+    std::vector<CharSet>        mFallbackSets;
+    std::vector<bool>           mFallbackKnown;
+
+};
+
+void Font::RenderGlyphsGDI(int size)
+{
+  vector<FontGlyph*> ToRender;
+
+  for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch) {
+      auto& G = Glyphs[Ch];
+      if (!G) {
+          continue;
+      }
+      Assert(G->Char == Ch);
+      if (G->HasBmp) {
+          continue;
+      }
+      ToRender.emplace_back(Glyphs[Ch].get());
+  }
+  auto spec = ParseFaceSpec(Faces[0]);
+  wstring wName = wstring(spec.Path.begin(), spec.Path.end());
+  FontLoader loader;
+  if (!loader.load(wName.c_str(), (int)spec.Index)) {
+      Abort("Load %lS failed\n", wName.c_str());
+  }
+  FontInfoImpl impl(loader.logFont(), size);
+  printf("FONT height: %ld\n", impl.metric().tmHeight);
+
+  MapSources(ToRender);
+  CharSet gaps;
+  for (auto& G: ToRender) {
+      if (!impl.covers(G->Source)) {
+          gaps.set(G->Source);
+      }
+  }
+  if (gaps.any()) {
+      Warn("No font covers %zu chars: %s", gaps.count(), gaps.Format().c_str());
+  }
+
+  for (auto& G: ToRender) {
+      GLYPHMETRICS gm;
+      wchar_t c = G->Source;
+      bool ok = impl.getBitmap(c, G->Bmp, &gm);
+      if (!ok) {
+          if (c == 0x3000) {
+              Warn("A1A1 not found, generate default blank character");
+              ok = impl.getBitmap(0x7530, G->Bmp, &gm);
+              if (ok) {
+                  Warn("Generate a1 w %zd h %zd", G->Bmp.Width(), G->Bmp.Height());
+                  G->Bmp.Fill({});
+              }
+          }
+          if (!ok && (c >= 32 && c < 127)) {
+              ok = impl.getBitmap(L'.', G->Bmp, &gm);
+              if (ok) {
+                  Warn("Replace %u(0x%x) with space w %zd h %zd", c, c, G->Bmp.Width(), G->Bmp.Height());
+                  G->Bmp.Fill({});
+              }
+          }
+      }
+      if (!ok) {
+          Warn("No glyph found for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
+          G->FillEmpty();
+          continue;
+      }
+      //Warn("Char %lc %zd %zd", G->Char, G->Bmp.Width(), G->Bmp.Height());
+      G->BearX = gm.gmBlackBoxX;
+      G->BearY = gm.gmBlackBoxY;
+      G->HasBmp = 2;
+      G->Advance = gm.gmCellIncX;
+  }
+
+  LnSpacing = impl.metric().tmHeight;
+  CapHeight = 1;
+}
+#endif
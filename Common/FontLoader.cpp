@@ -3,6 +3,7 @@
 #include <windows.h>
 #include <memory>
 #include "fontutil.hpp"
+#include "Gamma.hpp"
 
 
 //#define FIDBG
@@ -53,23 +54,10 @@ namespace {
 
 BYTE normalizeGray(BYTE gray)
 {
-    static BYTE map[65];
-    static bool isInited;
-    if (!isInited) {
-        for (int i = 0; i < ARRAYSIZE(map); i += 1) {
-            double output = 255 * pow(i / 64.0, 1 / 2.2);
-            int o = (int)output;
-            if (o > 255) {
-                o = 255;
-            }
-            map[i] = o;
-        }
-    }
-
-    if (gray >= ARRAYSIZE(map)) {
+    if (gray >= ARRAYSIZE(GdiGamma)) {
         return 0xff;
     }
-    return map[gray];
+    return GdiGamma[gray];
 }
 
 bool adjustFontSize(int fontWidth, int fontHeight, int offsetX, int offsetY, const GLYPHMETRICS& gm,
@@ -93,12 +81,12 @@ bool adjustFontSize(int fontWidth, int fontHeight, int offsetX, int offsetY, con
 
 }
 
-bool FontLoader::load(const wchar_t *fileName)
+bool FontLoader::load(const wchar_t *fileName, int faceIndex)
 {
     if (!mRes.load(fileName)) {
         return false;
     }
-    auto result = GetLogFontFromFileName(fileName, &mLf);
+    auto result = GetLogFontFromFileName(fileName, &mLf, faceIndex);
     if (result < 0) {
         return false;
     }
@@ -155,6 +143,42 @@ void FontInfo::dumpMetric()
     printf("    Leading:        %ld\n", mMetric.tmExternalLeading);
 }
 
+bool FontInfo::charSet(CharSet& set)
+{
+    set.reset();
+    if (mHdc == nullptr) {
+        return false;
+    }
+    DWORD size = GetFontUnicodeRanges(mHdc, nullptr);
+    if (size == 0) {
+        return false;
+    }
+    std::unique_ptr<BYTE[]> data(new BYTE[size]);
+    auto glyphSet = reinterpret_cast<GLYPHSET *>(data.get());
+    if (GetFontUnicodeRanges(mHdc, glyphSet) == 0) {
+        return false;
+    }
+    for (DWORD i = 0; i < glyphSet->cRanges; i += 1) {
+        auto& range = glyphSet->ranges[i];
+        size_t end = min((size_t)range.wcLow + range.cGlyphs, set.size());
+        for (size_t c = range.wcLow; c < end; c += 1) {
+            set.set(c);
+        }
+    }
+    return set.any();
+}
+
+bool FontInfo::hasGlyph(wchar_t c)
+{
+    WORD gi;
+
+    if (mHdc == nullptr) {
+        return false;
+    }
+    DWORD num = GetGlyphIndicesW(mHdc, &c, 1, &gi, GGI_MARK_NONEXISTING_GLYPHS);
+    return num == 1 && gi != 0xffff;
+}
+
 bool FontInfo::getBitmap(wchar_t c, Bitmap &bitmap, GLYPHMETRICS * outGm)
 {
     DWORD num;
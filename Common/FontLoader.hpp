@@ -2,6 +2,7 @@
 
 #include <windows.h>
 #include "Bitmap.hpp"
+#include "CharSet.hpp"
 
 class FontResource {
 public:
@@ -19,7 +20,7 @@ private:
 class FontLoader {
 public:
     explicit FontLoader();
-    bool load(const wchar_t * fileName);
+    bool load(const wchar_t * fileName, int faceIndex = 0);
     const LOGFONTW&      logFont() { return mLf; }
 
 private:
@@ -35,6 +36,10 @@ public:
     bool ok() { return mHFont != nullptr; }
     const TEXTMETRIC& metric() { return mMetric; }
     void dumpMetric();
+    // False when the font reports no ranges, in which case set is unknown
+    // rather than empty and chars should be checked with hasGlyph
+    bool charSet(CharSet& set);
+    bool hasGlyph(wchar_t c);
     bool getBitmap(wchar_t c, Bitmap& bitmap, GLYPHMETRICS * metrics=nullptr);
 
 private:
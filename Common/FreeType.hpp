@@ -0,0 +1,8 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#define FtAss(e_) ((void) (!(e_) || (Abort("FreeType call failed: " # e_ ""), 0)))
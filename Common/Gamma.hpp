@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Gamma 1/2.2 curves, 255 * pow(i / N, 1 / 2.2) truncated
+
+// For GGO_GRAY8_BITMAP levels (0..64)
+constexpr uint8_t GdiGamma[65] = {
+    0,  38,  52,  63,  72,  80,  86,  93,  99, 104, 109, 114, 119, 123, 127, 131,
+  135, 139, 143, 146, 150, 153, 156, 160, 163, 166, 169, 172, 175, 177, 180, 183,
+  186, 188, 191, 193, 196, 198, 201, 203, 205, 208, 210, 212, 215, 217, 219, 221,
+  223, 225, 227, 229, 232, 234, 236, 238, 239, 241, 243, 245, 247, 249, 251, 253,
+  255,
+};
+
+// For 8-bit FreeType coverage
+constexpr uint8_t CoverageGamma[256] = {
+    0,  20,  28,  33,  38,  42,  46,  49,  52,  55,  58,  61,  63,  65,  68,  70,
+   72,  74,  76,  78,  80,  81,  83,  85,  87,  88,  90,  91,  93,  94,  96,  97,
+   99, 100, 102, 103, 104, 106, 107, 108, 109, 111, 112, 113, 114, 115, 117, 118,
+  119, 120, 121, 122, 123, 124, 125, 126, 128, 129, 130, 131, 132, 133, 134, 135,
+  136, 136, 137, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 147, 148, 149,
+  150, 151, 152, 153, 153, 154, 155, 156, 157, 158, 158, 159, 160, 161, 162, 162,
+  163, 164, 165, 165, 166, 167, 168, 168, 169, 170, 171, 171, 172, 173, 174, 174,
+  175, 176, 176, 177, 178, 178, 179, 180, 181, 181, 182, 183, 183, 184, 185, 185,
+  186, 187, 187, 188, 189, 189, 190, 190, 191, 192, 192, 193, 194, 194, 195, 196,
+  196, 197, 197, 198, 199, 199, 200, 200, 201, 202, 202, 203, 203, 204, 205, 205,
+  206, 206, 207, 208, 208, 209, 209, 210, 210, 211, 212, 212, 213, 213, 214, 214,
+  215, 216, 216, 217, 217, 218, 218, 219, 219, 220, 220, 221, 222, 222, 223, 223,
+  224, 224, 225, 225, 226, 226, 227, 227, 228, 228, 229, 229, 230, 230, 231, 231,
+  232, 232, 233, 233, 234, 234, 235, 235, 236, 236, 237, 237, 238, 238, 239, 239,
+  240, 240, 241, 241, 242, 242, 243, 243, 244, 244, 245, 245, 246, 246, 247, 247,
+  248, 248, 249, 249, 249, 250, 250, 251, 251, 252, 252, 253, 253, 254, 254, 255,
+};
@@ -0,0 +1,168 @@
+#include "GlyphCache.hpp"
+
+#include <filesystem>
+
+#include "AutoFile.hpp"
+#include "FreeType.hpp"
+#include "Hash.hpp"
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  constexpr char Magic[4] = {'D', '2', 'G', 'C'};
+  constexpr uint32_t Version = 1;
+  // A FreeType upgrade may rasterize differently, so it starts a new cache
+  constexpr uint32_t FtVersion = FREETYPE_MAJOR << 16 | FREETYPE_MINOR << 8 | FREETYPE_PATCH;
+
+  // Key, metrics and extent of a record, followed by NRow * NCol bytes
+  constexpr size_t RecordSize = 8 + 4 + 4 + 4 + 2 + 1 + 1 + 1 + 4 + 4 + 4 + 2 + 2;
+
+  template<class T>
+  T Read(const uint8_t*& Ptr) {
+    T Res;
+    memcpy(&Res, Ptr, sizeof(T));
+    Ptr += sizeof(T);
+    return Res;
+  }
+}
+
+GlyphKey GlyphKey::Make(uint64_t FontHash, int32_t FaceIndex, uint32_t SdfSize, bool Gamma, const FontGlyph* G) noexcept {
+  GlyphKey Key;
+  Key.FontHash = FontHash;
+  Key.FaceIndex = FaceIndex;
+  Key.Size = G->Size;
+  Key.SdfSize = SdfSize;
+  Key.Source = G->Source;
+  Key.Flags = (uint8_t) ((G->AntiAliasing ? 1 : 0) | (G->AntiAliasing && Gamma ? 2 : 0) | (G->Blank ? 4 : 0));
+  return Key;
+}
+
+size_t GlyphKeyHash::operator ()(const GlyphKey& Key) const noexcept {
+  uint32_t Rest[4] = {(uint32_t) Key.FaceIndex, Key.Size, Key.SdfSize, (uint32_t) Key.Source << 8 | Key.Flags};
+  return (size_t) Hash64(Rest, sizeof(Rest), Key.FontHash);
+}
+
+void GlyphCache::Open(const string& CachePath) {
+  lock_guard<mutex> Lock(Mtx);
+  Path = CachePath;
+  Entries.clear();
+  Owned.clear();
+  File.Close();
+  Dirty = false;
+  if (!fs::exists(Path))
+    return;
+  File.Open(Path.c_str());
+  auto Ptr = File.Data();
+  auto End = Ptr + File.Size();
+  auto Current = File.Size() >= 12 && !memcmp(Ptr, Magic, 4);
+  Ptr += 4;
+  Current = Current && Read<uint32_t>(Ptr) == Version;
+  Current = Current && Read<uint32_t>(Ptr) == FtVersion;
+  if (!Current) {
+    Warn("Glyph cache %s was written by another version and is discarded", Path.c_str());
+    File.Close();
+    Dirty = true;
+    return;
+  }
+  while (End - Ptr >= (ptrdiff_t) RecordSize) {
+    GlyphKey Key;
+    Key.FontHash = Read<uint64_t>(Ptr);
+    Key.FaceIndex = Read<int32_t>(Ptr);
+    Key.Size = Read<uint32_t>(Ptr);
+    Key.SdfSize = Read<uint32_t>(Ptr);
+    Key.Source = Read<uint16_t>(Ptr);
+    Key.Flags = Read<uint8_t>(Ptr);
+    Entry E;
+    E.HasBmp = Read<uint8_t>(Ptr);
+    E.Valid = Read<uint8_t>(Ptr);
+    E.BearX = Read<int32_t>(Ptr);
+    E.BearY = Read<int32_t>(Ptr);
+    E.Advance = Read<uint32_t>(Ptr);
+    E.NRow = Read<uint16_t>(Ptr);
+    E.NCol = Read<uint16_t>(Ptr);
+    E.Data = Ptr;
+    if ((size_t) (End - Ptr) < (size_t) E.NRow * E.NCol)
+      break;
+    Ptr += (size_t) E.NRow * E.NCol;
+    Entries[Key] = E;
+  }
+  if (Ptr != End) {
+    Warn("Glyph cache %s is truncated, %zu glyphs are kept", Path.c_str(), Entries.size());
+    Dirty = true;
+  }
+}
+
+void GlyphCache::Save() {
+  {
+    lock_guard<mutex> Lock(Mtx);
+    if (!Dirty || Path.empty())
+      return;
+    auto TmpPath = Path + ".tmp";
+    {
+      AutoFile Out(TmpPath.c_str(), "wb");
+      Out.Put(Magic, 4);
+      Out.Put(Version);
+      Out.Put(FtVersion);
+      for (auto& [Key, E] : Entries) {
+        Out.Put(Key.FontHash);
+        Out.Put(Key.FaceIndex);
+        Out.Put(Key.Size);
+        Out.Put(Key.SdfSize);
+        Out.Put(Key.Source);
+        Out.Put(Key.Flags);
+        Out.Put(E.HasBmp);
+        Out.Put(E.Valid);
+        Out.Put(E.BearX);
+        Out.Put(E.BearY);
+        Out.Put(E.Advance);
+        Out.Put(E.NRow);
+        Out.Put(E.NCol);
+        Out.Put(E.Data, (size_t) E.NRow * E.NCol);
+      }
+    }
+    // The entries point into the mapping, which has to go before the rename
+    Entries.clear();
+    Owned.clear();
+    File.Close();
+    fs::rename(TmpPath, Path);
+  }
+  Open(Path);
+}
+
+bool GlyphCache::Find(const GlyphKey& Key, FontGlyph* G) {
+  lock_guard<mutex> Lock(Mtx);
+  auto It = Entries.find(Key);
+  if (It == Entries.end()) {
+    ++Misses;
+    return false;
+  }
+  ++Hits;
+  auto& E = It->second;
+  G->BearX = E.BearX;
+  G->BearY = E.BearY;
+  G->Advance = E.Advance;
+  G->HasBmp = E.HasBmp;
+  G->Valid = E.Valid;
+  if (E.HasBmp == 1) {
+    G->Bmp.Resize(1, 1);
+    G->Bmp.Fill({});
+  } else {
+    G->Mask.Resize(E.NRow, E.NCol);
+    copy(E.Data, E.Data + G->Mask.Count(), G->Mask.Raw());
+  }
+  return true;
+}
+
+void GlyphCache::Put(const GlyphKey& Key, const FontGlyph* G) {
+  if (!G->HasBmp || G->Mask.NRow() > UINT16_MAX || G->Mask.NCol() > UINT16_MAX)
+    return;
+  auto NByte = G->HasBmp == 2 ? G->Mask.Count() : 0;
+  unique_ptr<uint8_t[]> Data(new uint8_t[max(NByte, (size_t) 1)]);
+  copy(G->Mask.Raw(), G->Mask.Raw() + NByte, Data.get());
+  Entry E{G->BearX, G->BearY, G->Advance, G->HasBmp, (uint8_t) G->Valid,
+    (uint16_t) (NByte ? G->Mask.NRow() : 0), (uint16_t) (NByte ? G->Mask.NCol() : 0), Data.get()};
+  lock_guard<mutex> Lock(Mtx);
+  Entries[Key] = E;
+  Owned.push_back(move(Data));
+  Dirty = true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <mutex>
+
+#include "Font.hpp"
+#include "MappedFile.hpp"
+
+// What a rasterization depends on, besides the FreeType version
+struct GlyphKey {
+  uint64_t FontHash{}; // of the font file content
+  int32_t FaceIndex{};
+  uint32_t Size{};
+  uint32_t SdfSize{}; // 0: rendered natively
+  uint16_t Source{};
+  uint8_t Flags{};    // see GlyphKey::Make
+
+  static GlyphKey Make(uint64_t FontHash, int32_t FaceIndex, uint32_t SdfSize, bool Gamma, const FontGlyph* G) noexcept;
+
+  bool operator ==(const GlyphKey& Another) const noexcept {
+    return FontHash == Another.FontHash && FaceIndex == Another.FaceIndex && Size == Another.Size &&
+      SdfSize == Another.SdfSize && Source == Another.Source && Flags == Another.Flags;
+  }
+};
+
+struct GlyphKeyHash {
+  size_t operator ()(const GlyphKey& Key) const noexcept;
+};
+
+// Rasterizer output kept across runs in one packed file, so a rebuild after
+// a palette or spacing change loads every glyph instead of rendering it.
+// Entries hold the coverage before effects are applied.
+class GlyphCache {
+public:
+  GlyphCache() = default;
+  GlyphCache(const GlyphCache&) = delete;
+  ~GlyphCache() = default;
+
+  GlyphCache& operator =(const GlyphCache&) = delete;
+
+  // Maps the cache at Path; a missing, stale or damaged file starts empty
+  void Open(const string& Path);
+  // Writes the entries back if any were added
+  void Save();
+
+  // Restores the metrics and coverage of a cached glyph into G
+  bool Find(const GlyphKey& Key, FontGlyph* G);
+  void Put(const GlyphKey& Key, const FontGlyph* G);
+
+  size_t NHit() const noexcept { return Hits; }
+  size_t NMiss() const noexcept { return Misses; }
+private:
+  struct Entry {
+    int32_t BearX;
+    int32_t BearY;
+    uint32_t Advance;
+    uint8_t HasBmp;
+    uint8_t Valid;
+    uint16_t NRow;
+    uint16_t NCol;
+    const uint8_t* Data; // into File or Owned
+  };
+
+  string Path;
+  MappedFile File;
+  mutex Mtx;
+  unordered_map<GlyphKey, Entry, GlyphKeyHash> Entries;
+  vector<unique_ptr<uint8_t[]>> Owned;
+  size_t Hits{0};
+  size_t Misses{0};
+  bool Dirty{false};
+};
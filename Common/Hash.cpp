@@ -0,0 +1,57 @@
+#include "AutoFile.hpp"
+#include "Hash.hpp"
+
+#include <filesystem>
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  constexpr uint64_t Mul = 0x9e3779b97f4a7c15;
+
+  constexpr uint64_t Mix(uint64_t H) {
+    H ^= H >> 32;
+    H *= 0xd6e8feb86659fd93;
+    H ^= H >> 32;
+    return H;
+  }
+}
+
+uint64_t Hash64(const void* Data, size_t Size, uint64_t Seed) noexcept {
+  auto Ptr = (const uint8_t*) Data;
+  auto H = Seed ^ (Size * Mul);
+  auto i = size_t{0};
+  for (; i + 8 <= Size; i += 8) {
+    uint64_t W;
+    memcpy(&W, Ptr + i, 8);
+    H = (H ^ Mix(W)) * Mul;
+  }
+  if (i < Size) {
+    uint64_t W = 0;
+    memcpy(&W, Ptr + i, Size - i);
+    H = (H ^ Mix(W)) * Mul;
+  }
+  return Mix(H);
+}
+
+uint64_t HashFile(const char* Path) {
+  auto File = AutoFile(Path, "rb");
+  auto Size = File.Size();
+  vector<uint8_t> Buf(min(Size, (size_t) 1 << 20));
+  auto H = uint64_t{0};
+  for (auto Left = Size; Left; ) {
+    auto N = min(Left, Buf.size());
+    File.Get(Buf.data(), N);
+    H = Hash64(Buf.data(), N, H);
+    Left -= N;
+  }
+  return H;
+}
+
+bool ReplaceIfChanged(const char* TmpPath, const char* Path) {
+  if (fs::exists(Path) && fs::file_size(Path) == fs::file_size(TmpPath) && HashFile(Path) == HashFile(TmpPath)) {
+    fs::remove(TmpPath);
+    return false;
+  }
+  fs::rename(TmpPath, Path);
+  return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Common.hpp"
+
+// 64-bit content hash for cache keys; fast, not cryptographic
+uint64_t Hash64(const void* Data, size_t Size, uint64_t Seed = 0) noexcept;
+
+uint64_t HashFile(const char* Path);
+
+// Moves TmpPath over Path unless Path already holds the same bytes, in which
+// case TmpPath is removed and Path keeps its timestamp. Returns whether Path
+// was replaced.
+bool ReplaceIfChanged(const char* TmpPath, const char* Path);
@@ -0,0 +1,80 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char* Path) noexcept {
+  Open(Path);
+}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+void MappedFile::Open(const char* Path) noexcept {
+  if (!TryOpen(Path))
+    Abort("Failed to map %s", Path);
+}
+
+#ifdef _WIN32
+bool MappedFile::TryOpen(const char* Path) noexcept {
+  Close();
+  auto File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (File == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER Size;
+  auto Ok = GetFileSizeEx(File, &Size) != 0;
+  if (Ok && Size.QuadPart) {
+    Len = (size_t) Size.QuadPart;
+    Map = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    Ptr = Map ? (const uint8_t*) MapViewOfFile(Map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    Ok = Ptr != nullptr;
+  }
+  CloseHandle(File);
+  if (!Ok)
+    Close();
+  return Ok;
+}
+
+void MappedFile::Close() noexcept {
+  if (Ptr)
+    UnmapViewOfFile(Ptr);
+  if (Map)
+    CloseHandle(Map);
+  Ptr = nullptr;
+  Map = nullptr;
+  Len = 0;
+}
+#else
+bool MappedFile::TryOpen(const char* Path) noexcept {
+  Close();
+  auto Fd = open(Path, O_RDONLY);
+  if (Fd < 0)
+    return false;
+  struct stat St;
+  auto Ok = !fstat(Fd, &St);
+  if (Ok && St.st_size) {
+    auto Addr = mmap(nullptr, (size_t) St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+    Ok = Addr != MAP_FAILED;
+    if (Ok) {
+      Ptr = (const uint8_t*) Addr;
+      Len = (size_t) St.st_size;
+    }
+  }
+  close(Fd);
+  return Ok;
+}
+
+void MappedFile::Close() noexcept {
+  if (Ptr)
+    munmap((void*) Ptr, Len);
+  Ptr = nullptr;
+  Len = 0;
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Read-only view of a whole file, shared by every user of the bytes
+class MappedFile final {
+public:
+  constexpr MappedFile() noexcept = default;
+  MappedFile(const MappedFile&) = delete;
+  explicit MappedFile(const char* Path) noexcept;
+  ~MappedFile();
+
+  MappedFile& operator =(const MappedFile&) = delete;
+
+  const uint8_t* Data() const noexcept { return Ptr; }
+  size_t Size() const noexcept { return Len; }
+
+  void Open(const char* Path) noexcept;
+  // Same as Open, but false instead of an abort if Path cannot be mapped
+  bool TryOpen(const char* Path) noexcept;
+  void Close() noexcept;
+private:
+  const uint8_t* Ptr = nullptr;
+  size_t Len = 0;
+#ifdef _WIN32
+  void* Map = nullptr;
+#endif
+};
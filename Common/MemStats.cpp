@@ -0,0 +1,101 @@
+#include "AutoFile.hpp"
+#include "MemStats.hpp"
+
+#ifdef MEM_STATS
+#include <new>
+
+namespace {
+  void Raise(atomic<size_t>& Max, size_t Val) noexcept {
+    auto Old = Max.load(memory_order_relaxed);
+    while (Old < Val && !Max.compare_exchange_weak(Old, Val, memory_order_relaxed))
+      ;
+  }
+
+  constexpr double MiB(size_t Bytes) noexcept { return Bytes / 1048576.0; }
+
+  void Report() {
+    auto& Stats = MemStats::Global();
+    Stats.Print(stderr);
+    if (auto Path = getenv("MEM_STATS_JSON"))
+      Stats.SaveJson(Path);
+  }
+}
+
+thread_local size_t MemStats::Cur = 0;
+
+void MemStats::Alloc(size_t Bytes) noexcept {
+  auto Now = Live.fetch_add(Bytes, memory_order_relaxed) + Bytes;
+  Raise(Peak, Now);
+  NAlloc.fetch_add(1, memory_order_relaxed);
+  auto& P = Phases[Cur];
+  P.NAlloc.fetch_add(1, memory_order_relaxed);
+  P.Bytes.fetch_add(Bytes, memory_order_relaxed);
+  Raise(P.Peak, Now);
+}
+
+void MemStats::Free(size_t Bytes) noexcept {
+  Live.fetch_sub(Bytes, memory_order_relaxed);
+  NFree.fetch_add(1, memory_order_relaxed);
+}
+
+const char* MemStats::Enter(const char* Name) noexcept {
+  lock_guard<mutex> Lock(Mtx);
+  auto N = NPhase.load(memory_order_relaxed);
+  auto i = size_t{0};
+  while (i < N && strcmp(Phases[i].Name, Name))
+    ++i;
+  // Phases past the last slot are counted as the last one
+  if (i == N && N < MaxPhase) {
+    Phases[i].Name = Name;
+    NPhase.store(N + 1, memory_order_relaxed);
+  }
+  i = min(i, MaxPhase - 1);
+  Raise(Phases[i].Peak, Live.load(memory_order_relaxed));
+  return Phases[exchange(Cur, i)].Name;
+}
+
+const char* MemStats::Current() const noexcept {
+  // Cur only ever names a phase this thread entered
+  return Phases[Cur].Name;
+}
+
+void MemStats::Print(FILE* File) const {
+  fprintf(File, "Memory: peak %.1f MB, %.1f MB live, %zu allocations, %zu frees\n",
+    MiB(Peak), MiB(Live), NAlloc.load(), NFree.load());
+  fprintf(File, "%-24s %10s %16s %16s\n", "Phase", "Allocs", "Allocated (MB)", "High water (MB)");
+  for (auto i = size_t{0}; i < NPhase; ++i) {
+    auto& P = Phases[i];
+    fprintf(File, "%-24s %10zu %16.1f %16.1f\n", P.Name, P.NAlloc.load(), MiB(P.Bytes), MiB(P.Peak));
+  }
+}
+
+void MemStats::SaveJson(const char* Path) const {
+  auto File = AutoFile(Path, "wb");
+  fprintf(File.Raw(), "{\n  \"peakBytes\": %zu,\n  \"liveBytes\": %zu,\n  \"allocations\": %zu,\n  \"frees\": %zu,\n"
+    "  \"phases\": [", Peak.load(), Live.load(), NAlloc.load(), NFree.load());
+  for (auto i = size_t{0}; i < NPhase; ++i) {
+    auto& P = Phases[i];
+    fprintf(File.Raw(), "%s\n    {\"name\": \"%s\", \"allocations\": %zu, \"allocatedBytes\": %zu, \"highWaterBytes\": %zu}",
+      i ? "," : "", P.Name, P.NAlloc.load(), P.Bytes.load(), P.Peak.load());
+  }
+  fprintf(File.Raw(), "\n  ]\n}\n");
+}
+
+MemStats& MemStats::Global() {
+  static MemStats Stats;
+  // Registered after Stats is constructed, so it runs before Stats is gone
+  static auto Init = [] {
+    Stats.Enter("other");
+    atexit(Report);
+    // An allocation that fails reports once, then fails as it would have
+    set_new_handler([] {
+      set_new_handler(nullptr);
+      fprintf(stderr, "Out of memory\n");
+      Report();
+    });
+    return true;
+  }();
+  (void) Init;
+  return Stats;
+}
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Opt-in accounting of the pixel, sprite, palette map and DC6 encoder
+// allocations, compiled in by defining MEM_STATS. It tracks live and peak
+// bytes and, per pipeline phase (see MemPhase), the allocations made and the
+// most bytes live while the phase was current. The summary goes to stderr at
+// exit, or when an allocation fails, and as JSON to the file named by the
+// MEM_STATS_JSON environment variable. Without MEM_STATS, MemPhase does
+// nothing and MemAllocator is the standard allocator.
+#ifdef MEM_STATS
+#include <atomic>
+#include <mutex>
+
+class MemStats {
+public:
+  void Alloc(size_t Bytes) noexcept;
+  void Free(size_t Bytes) noexcept;
+  // Makes Name, which has to outlive the process, the current phase of the
+  // calling thread and returns its previous one. Pool chunks run in the
+  // phase of the thread that started the job. Live bytes are process-wide,
+  // so phases that run concurrently (as several targets do) each see the
+  // other's allocations in their high water.
+  const char* Enter(const char* Name) noexcept;
+  const char* Current() const noexcept;
+
+  void Print(FILE* File) const;
+  void SaveJson(const char* Path) const;
+
+  static MemStats& Global();
+private:
+  struct Phase {
+    const char* Name{};
+    atomic<size_t> NAlloc{0};
+    atomic<size_t> Bytes{0}; // allocated while current
+    atomic<size_t> Peak{0};  // most bytes live while current
+  };
+
+  static constexpr size_t MaxPhase = 64;
+
+  atomic<size_t> Live{0};
+  atomic<size_t> Peak{0};
+  atomic<size_t> NAlloc{0};
+  atomic<size_t> NFree{0};
+  array<Phase, MaxPhase> Phases{};
+  atomic<size_t> NPhase{0};
+  static thread_local size_t Cur; // index into Phases
+  mutex Mtx; // held while phases are added
+};
+
+// Counts what a container allocates in MemStats
+template<class T>
+struct MemAllocator : allocator<T> {
+  using value_type = T;
+
+  MemAllocator() noexcept = default;
+  template<class U>
+  MemAllocator(const MemAllocator<U>&) noexcept {}
+
+  template<class U>
+  struct rebind {
+    using other = MemAllocator<U>;
+  };
+
+  T* allocate(size_t N) {
+    MemStats::Global().Alloc(N * sizeof(T));
+    return allocator<T>::allocate(N);
+  }
+
+  void deallocate(T* Ptr, size_t N) noexcept {
+    MemStats::Global().Free(N * sizeof(T));
+    allocator<T>::deallocate(Ptr, N);
+  }
+};
+
+template<class T, class U>
+bool operator ==(const MemAllocator<T>&, const MemAllocator<U>&) noexcept { return true; }
+template<class T, class U>
+bool operator !=(const MemAllocator<T>&, const MemAllocator<U>&) noexcept { return false; }
+
+// Tags the allocations made in its scope with a pipeline phase
+class MemPhase {
+public:
+  explicit MemPhase(const char* Name) noexcept : Prev(MemStats::Global().Enter(Name)) {}
+  MemPhase(const MemPhase&) = delete;
+  ~MemPhase() { MemStats::Global().Enter(Prev); }
+
+  MemPhase& operator =(const MemPhase&) = delete;
+private:
+  const char* Prev;
+};
+#else
+template<class T>
+using MemAllocator = allocator<T>;
+
+class MemPhase {
+public:
+  explicit MemPhase(const char*) noexcept {}
+};
+#endif
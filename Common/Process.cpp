@@ -0,0 +1,86 @@
+#include "Process.hpp"
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+namespace {
+  // Quotes Arg as CommandLineToArgvW splits it
+  string Quote(const string& Arg) {
+    string Res = "\"";
+    auto NSlash = size_t{0};
+    for (auto Ch : Arg) {
+      if (Ch == '\\') {
+        ++NSlash;
+        continue;
+      }
+      Res.append(Ch == '"' ? NSlash * 2 + 1 : NSlash, '\\');
+      NSlash = 0;
+      Res += Ch;
+    }
+    Res.append(NSlash * 2, '\\');
+    return Res + '"';
+  }
+}
+
+ProcessStats RunProcess(const vector<string>& Args) {
+  string Cmd;
+  for (auto& Arg : Args)
+    Cmd += (Cmd.empty() ? "" : " ") + Quote(Arg);
+  STARTUPINFOA Si{};
+  Si.cb = sizeof(Si);
+  PROCESS_INFORMATION Pi{};
+  auto T0 = chrono::steady_clock::now();
+  if (!CreateProcessA(nullptr, Cmd.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &Si, &Pi))
+    Abort("Failed to run %s (error %lu)", Args[0].c_str(), GetLastError());
+  WaitForSingleObject(Pi.hProcess, INFINITE);
+  ProcessStats Res{};
+  Res.Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+  DWORD Code = 0;
+  GetExitCodeProcess(Pi.hProcess, &Code);
+  Res.ExitCode = (int) Code;
+  PROCESS_MEMORY_COUNTERS Pmc{};
+  if (GetProcessMemoryInfo(Pi.hProcess, &Pmc, sizeof(Pmc)))
+    Res.PeakBytes = Pmc.PeakWorkingSetSize;
+  CloseHandle(Pi.hThread);
+  CloseHandle(Pi.hProcess);
+  return Res;
+}
+#else
+ProcessStats RunProcess(const vector<string>& Args) {
+  vector<char*> Argv;
+  for (auto& Arg : Args)
+    Argv.push_back((char*) Arg.c_str());
+  Argv.push_back(nullptr);
+  fflush(stdout);
+  auto T0 = chrono::steady_clock::now();
+  auto Pid = fork();
+  if (Pid < 0)
+    Abort("Failed to run %s", Args[0].c_str());
+  if (!Pid) {
+    execvp(Argv[0], Argv.data());
+    _exit(127);
+  }
+  int Status = 0;
+  rusage Usage{};
+  if (wait4(Pid, &Status, 0, &Usage) < 0)
+    Abort("Failed to wait for %s", Args[0].c_str());
+  ProcessStats Res{};
+  Res.Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+  Res.ExitCode = WIFEXITED(Status) ? WEXITSTATUS(Status) : -1;
+#ifdef __APPLE__
+  Res.PeakBytes = (size_t) Usage.ru_maxrss;
+#else
+  Res.PeakBytes = (size_t) Usage.ru_maxrss * 1024;
+#endif
+  return Res;
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Common.hpp"
+
+// What a finished child process took
+struct ProcessStats {
+  int ExitCode;
+  double Ms;        // wall time
+  size_t PeakBytes; // peak working set (resident set size elsewhere)
+};
+
+// Runs Args[0] with the rest as its arguments, sharing the console, and
+// waits for it; aborts if it cannot be started
+ProcessStats RunProcess(const vector<string>& Args);
@@ -0,0 +1,52 @@
+#include "RangeSet.hpp"
+
+void RangeSet::Add(uint32_t First, uint32_t Last) {
+  if (First > Last)
+    swap(First, Last);
+  // Every range that overlaps or touches [First, Last] merges into it
+  auto Beg = lower_bound(Items.begin(), Items.end(), First,
+    [](const Range& R, uint32_t Ch) { return (uint64_t) R.second + 1 < Ch; });
+  auto End = Beg;
+  while (End != Items.end() && End->first <= (uint64_t) Last + 1) {
+    First = min(First, End->first);
+    Last = max(Last, End->second);
+    ++End;
+  }
+  Items.insert(Items.erase(Beg, End), {First, Last});
+}
+
+void RangeSet::Add(const RangeSet& Another) {
+  for (auto& R : Another.Items)
+    Add(R.first, R.second);
+}
+
+void RangeSet::Subtract(const RangeSet& Another) {
+  vector<Range> Res;
+  auto Cut = Another.Items.begin();
+  for (auto [First, Last] : Items) {
+    while (Cut != Another.Items.end() && Cut->second < First)
+      ++Cut;
+    auto Pos = (uint64_t) First;
+    for (auto It = Cut; It != Another.Items.end() && It->first <= Last; ++It) {
+      if (It->first > Pos)
+        Res.emplace_back((uint32_t) Pos, It->first - 1);
+      Pos = max(Pos, (uint64_t) It->second + 1);
+    }
+    if (Pos <= Last)
+      Res.emplace_back((uint32_t) Pos, Last);
+  }
+  Items = move(Res);
+}
+
+bool RangeSet::Contains(uint32_t Ch) const noexcept {
+  auto It = lower_bound(Items.begin(), Items.end(), Ch,
+    [](const Range& R, uint32_t Ch) { return R.second < Ch; });
+  return It != Items.end() && It->first <= Ch;
+}
+
+size_t RangeSet::Count() const noexcept {
+  auto N = size_t{0};
+  for (auto& R : Items)
+    N += (size_t) R.second - R.first + 1;
+  return N;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Codepoints as sorted, disjoint and non-adjacent [First, Last] intervals
+class RangeSet {
+public:
+  using Range = pair<uint32_t, uint32_t>;
+
+  void Add(uint32_t First, uint32_t Last);
+  void Add(const RangeSet& Another);
+  void Subtract(const RangeSet& Another);
+
+  bool Contains(uint32_t Ch) const noexcept;
+  bool Empty() const noexcept { return Items.empty(); }
+  // Number of codepoints
+  size_t Count() const noexcept;
+
+  const vector<Range>& Ranges() const noexcept { return Items; }
+private:
+  vector<Range> Items;
+};
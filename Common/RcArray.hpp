@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Common.hpp"
+#include "MemStats.hpp"
 
 template<class Elem>
 class RcArray {
@@ -29,8 +30,22 @@ public:
   const Elem* Raw() const noexcept { return Data.get(); }
 
   void Resize(size_t R, size_t C) noexcept {
-    if (NR * NC < R * C)
-      Data.reset(new Elem[R * C]);
+    if (!Data.get_deleter().Owned || NR * NC < R * C) {
+#ifdef MEM_STATS
+      Data = Storage(new Elem[R * C], Release{true, R * C * sizeof(Elem)});
+      MemStats::Global().Alloc(R * C * sizeof(Elem));
+#else
+      Data = Storage(new Elem[R * C]);
+#endif
+    }
+    NR = R;
+    NC = C;
+  }
+
+  // Views R x C elements at Ptr, which must outlive the view and is never
+  // written through it; the next Resize gives the array storage of its own
+  void Borrow(const Elem* Ptr, size_t R, size_t C) noexcept {
+    Data = Storage(const_cast<Elem*>(Ptr), Release{false});
     NR = R;
     NC = C;
   }
@@ -46,7 +61,23 @@ public:
   Elem* operator [](size_t R) noexcept { return Raw() + R * NC; }
   const Elem* operator [](size_t R) const noexcept { return Raw() + R * NC; }
 private:
+  struct Release {
+    bool Owned{true};
+#ifdef MEM_STATS
+    size_t Bytes{0};
+#endif
+    void operator ()(Elem* Ptr) const noexcept {
+      if (!Owned)
+        return;
+#ifdef MEM_STATS
+      MemStats::Global().Free(Bytes);
+#endif
+      delete[] Ptr;
+    }
+  };
+  using Storage = unique_ptr<Elem[], Release>;
+
   size_t NR = 0;
   size_t NC = 0;
-  unique_ptr<Elem[]> Data;
+  Storage Data;
 };
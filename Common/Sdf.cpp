@@ -0,0 +1,229 @@
+#include "Sdf.hpp"
+
+#include <cmath>
+
+#include "FaceCache.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SDF_SSE2
+#endif
+
+namespace {
+  constexpr float Far = 1e20f;
+
+  // Squared distance transform of one line (Felzenszwalb & Huttenlocher),
+  // in place; F is 0 on seeds and Far elsewhere
+  void Edt1(float* F, size_t N, size_t Stride, vector<float>& D, vector<size_t>& V, vector<float>& Z) {
+    D.resize(N);
+    V.resize(N);
+    Z.resize(N + 1);
+    auto Seeded = false;
+    for (auto i = size_t{0}; i < N; ++i) {
+      D[i] = F[i * Stride];
+      Seeded |= D[i] < Far;
+    }
+    // Nothing to propagate, and the padding is mostly such lines
+    if (!Seeded)
+      return;
+    auto K = size_t{0};
+    V[0] = 0;
+    Z[0] = -Far;
+    Z[1] = Far;
+    for (auto Q = size_t{1}; Q < N; ++Q) {
+      auto S = 0.f;
+      for (;;) {
+        auto P = V[K];
+        S = ((D[Q] + (float) (Q * Q)) - (D[P] + (float) (P * P))) / (2.f * Q - 2.f * P);
+        if (S > Z[K] || !K)
+          break;
+        --K;
+      }
+      ++K;
+      V[K] = Q;
+      Z[K] = S;
+      Z[K + 1] = Far;
+    }
+    K = 0;
+    for (auto Q = size_t{0}; Q < N; ++Q) {
+      while (Z[K + 1] < Q)
+        ++K;
+      auto Dist = (float) Q - (float) V[K];
+      F[Q * Stride] = Dist * Dist + D[V[K]];
+    }
+  }
+
+  void Edt(vector<float>& F, size_t NRow, size_t NCol) {
+    vector<float> D, Z;
+    vector<size_t> V;
+    for (auto j = size_t{0}; j < NCol; ++j)
+      Edt1(F.data() + j, NRow, NCol, D, V, Z);
+    for (auto i = size_t{0}; i < NRow; ++i)
+      Edt1(F.data() + i * NCol, NCol, 1, D, V, Z);
+  }
+}
+
+void MeasureSdf(FT_Face Face, FT_UInt GIdx, SdfGlyph& Sdf) {
+  Sdf = {};
+  if (!GIdx)
+    return;
+  Sdf.Exists = true;
+  // Hinting is meaningless once the field is scaled, and would skew the
+  // metrics derived from it
+  FtAss(FT_Load_Glyph(Face, GIdx, FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP));
+  auto& Ftg = Face->glyph;
+  Sdf.Spread = max(4u, (uint32_t) Face->size->metrics.y_ppem / 8);
+  Sdf.Left = Ftg->bitmap_left;
+  Sdf.Top = Ftg->bitmap_top;
+  Sdf.NRow = Ftg->bitmap.rows;
+  Sdf.NCol = Ftg->bitmap.width;
+  Sdf.Advance = Ftg->advance.x;
+}
+
+void BuildSdf(FT_Face Face, FT_UInt GIdx, SdfGlyph& Sdf) {
+  MeasureSdf(Face, GIdx, Sdf);
+  if (!Sdf.NRow || !Sdf.NCol)
+    return;
+  if (Face->glyph->format != FT_GLYPH_FORMAT_BITMAP)
+    FtAss(FT_Render_Glyph(Face->glyph, FT_RENDER_MODE_NORMAL));
+  auto& Ftb = Face->glyph->bitmap;
+  if (Ftb.pixel_mode != FT_PIXEL_MODE_GRAY)
+    Abort("Signed distance fields need an outline font");
+  auto Pad = Sdf.Spread;
+  auto NRow = Sdf.NRow + 2 * Pad;
+  auto NCol = Sdf.NCol + 2 * Pad;
+  Coverage Cov(NRow, NCol);
+  Cov.Fill(0);
+  for (auto i = 0u; i < Ftb.rows; ++i) {
+    auto Row = Ftb.buffer + (ptrdiff_t) i * Ftb.pitch;
+    copy(Row, Row + Ftb.width, Cov[i + Pad] + Pad);
+  }
+  // Outline pixels are partly covered or border the other side; every
+  // other pixel takes its distance to the nearest of them
+  auto Inside = [&](size_t i, size_t j) { return Cov[i][j] >= 128; };
+  vector<float> ToEdge(NRow * NCol, Far);
+  for (auto i = size_t{1}; i + 1 < NRow; ++i)
+    for (auto j = size_t{1}; j + 1 < NCol; ++j) {
+      auto C = Cov[i][j];
+      auto In = Inside(i, j);
+      if ((C > 0 && C < 255) || In != Inside(i - 1, j) || In != Inside(i + 1, j) ||
+          In != Inside(i, j - 1) || In != Inside(i, j + 1))
+        ToEdge[i * NCol + j] = 0.f;
+    }
+  Edt(ToEdge, NRow, NCol);
+  Sdf.Field.Resize(NRow, NCol);
+  for (auto i = size_t{0}; i < ToEdge.size(); ++i) {
+    auto C = Cov.Raw()[i];
+    auto D = sqrt(ToEdge[i]);
+    // Partial coverage places the outline within the pixel
+    if (C > 0 && C < 255)
+      D = C / 255.f - .5f;
+    else if (!ToEdge[i])
+      D = C ? .5f : -.5f;
+    else if (!C)
+      D = -D;
+    Sdf.Field.Raw()[i] = (uint8_t) clamp(lround(128.f + D * 127.f / Pad), 0l, 255l);
+  }
+}
+
+void SdfExtent(const SdfGlyph& Sdf, float Scale, int32_t& Left, int32_t& Top, size_t& NRow, size_t& NCol) {
+  Left = (int32_t) floor(Sdf.Left * Scale);
+  Top = (int32_t) ceil(Sdf.Top * Scale);
+  auto Right = (int32_t) ceil((Sdf.Left + (int32_t) Sdf.NCol) * Scale);
+  auto Bottom = (int32_t) floor((Sdf.Top - (int32_t) Sdf.NRow) * Scale);
+  NRow = (size_t) max(Top - Bottom, 1);
+  NCol = (size_t) max(Right - Left, 1);
+}
+
+void SampleSdf(const SdfGlyph& Sdf, float Scale, bool AntiAliasing,
+  Coverage& Mask, int32_t& Left, int32_t& Top) {
+  size_t NRow, NCol;
+  SdfExtent(Sdf, Scale, Left, Top, NRow, NCol);
+  Mask.Resize(NRow, NCol);
+  auto& F = Sdf.Field;
+  auto Pad = (float) Sdf.Spread;
+  // Field value in 8.8 fixed point, looked up by its top 10 bits; the table
+  // only changes with the target size
+  thread_local array<uint8_t, 1024> Lut;
+  thread_local float LutKey{};
+  auto Key = AntiAliasing ? Pad * Scale : -Pad * Scale;
+  if (LutKey != Key) {
+    LutKey = Key;
+    for (auto i = 0u; i < Lut.size(); ++i) {
+      auto Dist = ((i + .5f) / 4.f - 128.f) * Pad / 127.f * Scale;
+      if (AntiAliasing)
+        Lut[i] = (uint8_t) lround(clamp(Dist + .5f, 0.f, 1.f) * 255.f);
+      else
+        // Biased towards ink, or 1px stems that straddle pixel centers vanish
+        Lut[i] = Dist >= -.15f ? 255 : 0;
+    }
+  }
+  // Every target column reads the same two field columns on each row
+  vector<uint32_t> X0(NCol), X1(NCol), WX(NCol);
+  for (auto c = size_t{0}; c < NCol; ++c) {
+    auto Fx = (Left + (float) c + .5f) / Scale - Sdf.Left + Pad - .5f;
+    Fx = clamp(Fx, 0.f, (float) (F.NCol() - 1));
+    X0[c] = (uint32_t) Fx;
+    X1[c] = min(X0[c] + 1, (uint32_t) F.NCol() - 1);
+    WX[c] = (uint32_t) ((Fx - X0[c]) * 256.f);
+  }
+  vector<uint16_t> Lerp(F.NCol());
+  for (auto r = size_t{0}; r < NRow; ++r) {
+    auto Fy = Sdf.Top + Pad - (Top - (float) r - .5f) / Scale - .5f;
+    Fy = clamp(Fy, 0.f, (float) (F.NRow() - 1));
+    auto Y0 = (size_t) Fy;
+    auto Y1 = min(Y0 + 1, F.NRow() - 1);
+    auto WY = (uint32_t) ((Fy - Y0) * 256.f);
+    auto A = F[Y0], B = F[Y1];
+    auto j = size_t{0};
+#ifdef SDF_SSE2
+    // Both products and their sum stay within 255 * 256, so 16-bit lanes are
+    // exact
+    auto Zero = _mm_setzero_si128();
+    auto MA = _mm_set1_epi16((int16_t) (256 - WY));
+    auto MB = _mm_set1_epi16((int16_t) WY);
+    for (; j + 16 <= F.NCol(); j += 16) {
+      auto VA = _mm_loadu_si128((const __m128i*) (A + j));
+      auto VB = _mm_loadu_si128((const __m128i*) (B + j));
+      auto Lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(VA, Zero), MA),
+        _mm_mullo_epi16(_mm_unpacklo_epi8(VB, Zero), MB));
+      auto Hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(VA, Zero), MA),
+        _mm_mullo_epi16(_mm_unpackhi_epi8(VB, Zero), MB));
+      _mm_storeu_si128((__m128i*) (Lerp.data() + j), Lo);
+      _mm_storeu_si128((__m128i*) (Lerp.data() + j + 8), Hi);
+    }
+#endif
+    for (; j < F.NCol(); ++j)
+      Lerp[j] = (uint16_t) (A[j] * (256 - WY) + B[j] * WY);
+    // The horizontal pass gathers through X0/X1, which SSE2 cannot, so it
+    // stays scalar
+    auto Out = Mask[r];
+    for (auto c = size_t{0}; c < NCol; ++c) {
+      auto V = (Lerp[X0[c]] * (256 - WX[c]) + Lerp[X1[c]] * WX[c]) >> 8;
+      Out[c] = Lut[V >> 6];
+    }
+  }
+}
+
+const SdfGlyph& SdfCache::Get(FT_Face Face, const string& Spec, uint16_t Ch, uint32_t Size) {
+  auto [Path, Index] = ParseFaceSpec(Spec);
+  auto Key = make_tuple(FaceCache::Global().Load(Path).Hash, Index, Ch, Size);
+  {
+    lock_guard<mutex> Lock(Mtx);
+    auto It = Glyphs.find(Key);
+    if (It != Glyphs.end())
+      return *It->second;
+  }
+  auto Sdf = make_unique<SdfGlyph>();
+  BuildSdf(Face, FT_Get_Char_Index(Face, Ch), *Sdf);
+  lock_guard<mutex> Lock(Mtx);
+  auto& Res = Glyphs[Key];
+  if (!Res)
+    Res = move(Sdf);
+  return *Res;
+}
+
+SdfCache& SdfCache::Global() {
+  static SdfCache Cache;
+  return Cache;
+}
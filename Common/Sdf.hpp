@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include "Bitmap.hpp"
+#include "FreeType.hpp"
+
+// A glyph rendered once at a large size and kept as a signed distance field,
+// so every smaller size is a resample instead of another rasterization
+struct SdfGlyph {
+  bool Exists{};     // the face has a glyph for the char
+  uint32_t Spread{}; // field pixels between the outline and 0 or 255
+  int32_t Left{};    // bearings and extent of the plain render
+  int32_t Top{};
+  uint32_t NRow{};
+  uint32_t NCol{};
+  FT_Pos Advance{};  // 26.6
+  Coverage Field{};  // 128 on the outline, larger inside; padded by Spread
+};
+
+// Fills everything but the field, without rendering
+void MeasureSdf(FT_Face Face, FT_UInt GIdx, SdfGlyph& Sdf);
+
+// Renders glyph GIdx of Face at its current pixel size
+void BuildSdf(FT_Face Face, FT_UInt GIdx, SdfGlyph& Sdf);
+
+// Bearings and extent of the glyph scaled by Scale, as SampleSdf lays it out
+void SdfExtent(const SdfGlyph& Sdf, float Scale, int32_t& Left, int32_t& Top, size_t& NRow, size_t& NCol);
+
+// Coverage of the glyph scaled by Scale, with its bearings at that scale
+void SampleSdf(const SdfGlyph& Sdf, float Scale, bool AntiAliasing,
+  Coverage& Mask, int32_t& Left, int32_t& Top);
+
+// Fields per (font file content, face index, char, size), shared by all
+// targets and threads
+class SdfCache {
+public:
+  // Spec is a face as accepted by FaceCache, and Face is opened from it and
+  // set to Size
+  const SdfGlyph& Get(FT_Face Face, const string& Spec, uint16_t Ch, uint32_t Size);
+
+  static SdfCache& Global();
+private:
+  mutex Mtx;
+  map<tuple<uint64_t, FT_Long, uint16_t, uint32_t>, unique_ptr<SdfGlyph>> Glyphs;
+};
@@ -1,26 +1,45 @@
-#include <windows.h>
 #include "AutoFile.hpp"
+#include "MappedFile.hpp"
 #include "Sprite.hpp"
 
 namespace {
   constexpr uint32_t Dc6HdrVer = 0x00000006;
   constexpr uint32_t Dc6HdrUnk1 = 0x00000001;
 
-#ifdef BMP_ALPHA
-  void ReadDc6Frame(AutoFile& File, Bitmap& Bmp, const Dc6FrameHeader& Frm, const Palette& Pal) {
-#else
-  void ReadDc6Frame(AutoFile& File, Bitmap& Bmp, const Dc6FrameHeader& Frm, const Palette& Pal, uint32_t Mask) {
-#endif
-    Bmp.Resize(Frm.Width, Frm.Height);
-#ifdef BMP_ALPHA
-    Bmp.Fill({});
-#else
-    Bmp.Fill(Mask);
-#endif
-    auto y = Bmp.Height() - 1;
+  // Reads a T at Off of a DC6 in memory
+  template<class T>
+  T ReadDc6At(const uint8_t* Data, size_t Size, size_t Off) {
+    if (Off > Size || Size - Off < sizeof(T))
+      Abort("DC6 is truncated: %zu bytes wanted at %zu of %zu", sizeof(T), Off, Size);
+    T Res;
+    memcpy(&Res, Data + Off, sizeof(T));
+    return Res;
+  }
+
+  // Frame offsets, one row per direction
+  RcArray<uint32_t> ReadDc6Header(const uint8_t* Data, size_t Size) {
+    auto Hdr = ReadDc6At<Dc6Header>(Data, Size, 0);
+    if (Hdr.Version != Dc6HdrVer)
+      Abort("DC6 file should start with %.8x instead of %.8x", Dc6HdrVer, Hdr.Version);
+    if ((Size - sizeof(Hdr)) / sizeof(uint32_t) < (uint64_t) Hdr.NDir * Hdr.NFrm)
+      Abort("DC6 is truncated: %u x %u frame offsets do not fit %zu bytes", Hdr.NDir, Hdr.NFrm, Size);
+    auto Offs = RcArray<uint32_t>(Hdr.NDir, Hdr.NFrm);
+    memcpy(Offs.Raw(), Data + sizeof(Hdr), Offs.Count() * sizeof(uint32_t));
+    return Offs;
+  }
+
+  // Decodes the runs of a frame, calling Put(x, y, c) for every pixel
+  template<class FnPut>
+  void DecodeDc6Frame(const uint8_t* Data, size_t Size, size_t Off, const Dc6FrameHeader& Frm, FnPut&& Put) {
+    Off += sizeof(Dc6FrameHeader);
+    if (Off > Size || Size - Off < Frm.Length)
+      Abort("DC6 is truncated: a %u-byte frame does not fit at %zu of %zu", Frm.Length, Off, Size);
+    auto Ptr = Data + Off;
+    auto End = Ptr + Frm.Length;
+    auto y = (size_t) Frm.Height - 1;
     auto x = size_t{0};
-    for (auto i = 0u; i < Frm.Length; ++i) {
-      auto b = File.Get<uint8_t>();
+    while (Ptr < End) {
+      auto b = *Ptr++;
       if (b == 0x80) {
         x = 0;
         --y;
@@ -28,24 +47,44 @@ namespace {
       else if (b & 0x80)
         x += b & 0x7f;
       else {
-        for (auto j = 0u; j < b; ++j, ++i) {
-          auto c = File.Get<uint8_t>();
-          if (c > 255)
-            Abort("Invalid color index: %u", c);
-          if (y >= Bmp.Height() || x >= Bmp.Width())
-            Abort("Invalid position (%zu,%zu)", x, y);
-          Bmp[y][x++] = Pal[c];
-        }
+        if (End - Ptr < b)
+          Abort("DC6 frame ends within a run of %u pixels", b);
+        if (y >= Frm.Height || x + b > Frm.Width)
+          Abort("Invalid position (%zu,%zu)", x + b, y);
+        for (auto j = 0u; j < b; ++j)
+          Put(x++, y, *Ptr++);
       }
     }
   }
 
+#ifdef BMP_ALPHA
+  void ReadDc6Frame(const uint8_t* Data, size_t Size, size_t Off, Bitmap& Bmp, const Dc6FrameHeader& Frm,
+    const Palette& Pal) {
+#else
+  void ReadDc6Frame(const uint8_t* Data, size_t Size, size_t Off, Bitmap& Bmp, const Dc6FrameHeader& Frm,
+    const Palette& Pal, uint32_t Mask) {
+#endif
+    Bmp.Resize(Frm.Width, Frm.Height);
+#ifdef BMP_ALPHA
+    Bmp.Fill({});
+#else
+    Bmp.Fill(Mask);
+#endif
+    DecodeDc6Frame(Data, Size, Off, Frm, [&](size_t x, size_t y, uint8_t c) { Bmp[y][x] = Pal[c]; });
+  }
+
+  void ReadDc6Frame(const uint8_t* Data, size_t Size, size_t Off, IndexedBitmap& Bmp, const Dc6FrameHeader& Frm) {
+    Bmp.Resize(Frm.Width, Frm.Height);
+    Bmp.Fill(0);
+    DecodeDc6Frame(Data, Size, Off, Frm, [&](size_t x, size_t y, uint8_t c) { Bmp[y][x] = c; });
+  }
+
 #ifdef BMP_ALPHA
   void WriteDc6Frame(AutoFile& File, const Bitmap& Bmp, PalEncoder& Enc) {
 #else
   void WriteDc6Frame(AutoFile& File, const Bitmap& Bmp, PalEncoder& Enc, uint32_t Mask) {
 #endif
-    vector<uint8_t> encoded;
+    vector<uint8_t, MemAllocator<uint8_t>> encoded;
     if (Bmp.Count()) {
       auto Done = false;
       auto y = Bmp.Height() - 1;
@@ -121,23 +160,32 @@ namespace {
 
 #ifdef BMP_ALPHA
 void Sprite::ReadDc6(const char* Path, const Palette& Pal) {
+  MappedFile File(Path);
+  ReadDc6(File.Data(), File.Size(), Pal);
+}
 #else
 void Sprite::ReadDc6(const char* Path, const Palette& Pal, uint32_t Mask) {
+  MappedFile File(Path);
+  ReadDc6(File.Data(), File.Size(), Pal, Mask);
+}
 #endif
-  auto File = AutoFile(Path, "rb");
-  auto Hdr = File.Get<Dc6Header>();
-  if (Hdr.Version != Dc6HdrVer)
-    Abort("DC6 file should start with %.8x instead of %.8x", Dc6HdrVer, Hdr.Version);
-  Resize(Hdr.NDir, Hdr.NFrm);
-  auto Offs = RcArray<uint32_t>(Hdr.NDir, Hdr.NFrm);
-  File.Get(Offs.Raw(), Offs.Count());
-  for (uint32_t IDir = 0; IDir < Hdr.NDir; ++IDir)
-    for (uint32_t IFrm = 0; IFrm < Hdr.NFrm; ++IFrm) {
-      auto Frm = File.GetAt<Dc6FrameHeader>(Offs[IDir][IFrm]);
+
 #ifdef BMP_ALPHA
-      ReadDc6Frame(File, (*this)[IDir][IFrm], Frm, Pal);
+void Sprite::ReadDc6(const uint8_t* Data, size_t Size, const Palette& Pal) {
 #else
-      ReadDc6Frame(File, (*this)[IDir][IFrm], Frm, Pal, Mask);
+void Sprite::ReadDc6(const uint8_t* Data, size_t Size, const Palette& Pal, uint32_t Mask) {
+#endif
+  auto Offs = ReadDc6Header(Data, Size);
+  Resize(Offs.NRow(), Offs.NCol());
+  Headers.Resize(Offs.NRow(), Offs.NCol());
+  for (auto IDir = size_t{0}; IDir < Offs.NRow(); ++IDir)
+    for (auto IFrm = size_t{0}; IFrm < Offs.NCol(); ++IFrm) {
+      auto Off = Offs[IDir][IFrm];
+      auto& Frm = Headers[IDir][IFrm] = ReadDc6At<Dc6FrameHeader>(Data, Size, Off);
+#ifdef BMP_ALPHA
+      ReadDc6Frame(Data, Size, Off, (*this)[IDir][IFrm], Frm, Pal);
+#else
+      ReadDc6Frame(Data, Size, Off, (*this)[IDir][IFrm], Frm, Pal, Mask);
 #endif
     }
 }
@@ -147,7 +195,7 @@ void Sprite::SaveDc6(const char* Path, const Palette& Pal) {
 #else
 void Sprite::SaveDc6(const char* Path, const Palette& Pal, uint32_t Mask) {
 #endif
-    DeleteFileA(Path);
+    remove(Path);
   Dc6Header Hdr;
   Hdr.Version = Dc6HdrVer;
   Hdr.Unk1 = Dc6HdrUnk1;
@@ -187,3 +235,15 @@ void Sprite::SaveDc6(const char* Path, const Palette& Pal, uint32_t Mask) {
     }
   File.PutAt(Offs.Raw(), FpOffs, Offs.Count());
 }
+
+void IndexedSprite::ReadDc6(const char* Path) {
+  MappedFile File(Path);
+  auto Offs = ReadDc6Header(File.Data(), File.Size());
+  Resize(Offs.NRow(), Offs.NCol());
+  for (auto IDir = size_t{0}; IDir < Offs.NRow(); ++IDir)
+    for (auto IFrm = size_t{0}; IFrm < Offs.NCol(); ++IFrm) {
+      auto Off = Offs[IDir][IFrm];
+      auto Frm = ReadDc6At<Dc6FrameHeader>(File.Data(), File.Size(), Off);
+      ReadDc6Frame(File.Data(), File.Size(), Off, (*this)[IDir][IFrm], Frm);
+    }
+}
@@ -30,14 +30,35 @@ public:
   constexpr size_t NDir() const noexcept { return NRow(); }
   constexpr size_t NFrm() const noexcept { return NCol(); }
 
+  // Headers of the frames as last read, for their offsets; SaveDc6 ignores them
+  RcArray<Dc6FrameHeader> Headers;
+
 #ifdef BMP_ALPHA
   void ReadDc6(const char* Path, const Palette& Pal);
+  // Decodes a DC6 already in memory
+  void ReadDc6(const uint8_t* Data, size_t Size, const Palette& Pal);
   void SaveDc6(const char* Path, const Palette& Pal);
 #else
   void ReadDc6(const char* Path, const Palette& Pal, uint32_t Mask = 0x000000);
+  // Decodes a DC6 already in memory
+  void ReadDc6(const uint8_t* Data, size_t Size, const Palette& Pal, uint32_t Mask = 0x000000);
   void SaveDc6(const char* Path, const Palette& Pal, uint32_t Mask = 0x000000);
 #endif
 private:
   using RcArray::NRow;
   using RcArray::NCol;
 };
+
+// A DC6 kept as palette indices, as the game draws it
+class IndexedSprite : public RcArray<IndexedBitmap> {
+public:
+  using RcArray::RcArray;
+
+  constexpr size_t NDir() const noexcept { return NRow(); }
+  constexpr size_t NFrm() const noexcept { return NCol(); }
+
+  void ReadDc6(const char* Path);
+private:
+  using RcArray::NRow;
+  using RcArray::NCol;
+};
@@ -0,0 +1,59 @@
+#include "T2S.hpp"
+
+namespace {
+  struct T2SPair {
+    uint16_t From;
+    uint16_t To;
+  };
+
+  constexpr T2SPair Pairs[] = {
+#include "T2SData.inc"
+  };
+
+  constexpr bool IsSorted() {
+    for (auto i = size_t{1}; i < size(Pairs); ++i)
+      if (Pairs[i - 1].From >= Pairs[i].From)
+        return false;
+    return true;
+  }
+
+  static_assert(IsSorted(), "T2SData.inc should be sorted without duplicates");
+
+  constexpr size_t CountPages() {
+    bool Used[256]{};
+    auto N = size_t{0};
+    for (auto& P : Pairs)
+      if (!Used[P.From >> 8]) {
+        Used[P.From >> 8] = true;
+        ++N;
+      }
+    return N;
+  }
+
+  constexpr size_t NPage = CountPages();
+
+  static_assert(NPage < 256, "Too many T2S pages");
+
+  // Two-level table: the high byte selects a page, page 0 maps nothing
+  struct T2STable {
+    uint8_t PageIdx[256];
+    uint16_t Pages[NPage + 1][256];
+
+    constexpr T2STable() : PageIdx{}, Pages{} {
+      auto N = 0u;
+      for (auto& P : Pairs) {
+        auto& Idx = PageIdx[P.From >> 8];
+        if (!Idx)
+          Idx = (uint8_t) ++N;
+        Pages[Idx][P.From & 0xff] = P.To;
+      }
+    }
+  };
+
+  constexpr T2STable Table;
+}
+
+uint16_t ToSimplified(uint16_t Ch) noexcept {
+  auto To = Table.Pages[Table.PageIdx[Ch >> 8]][Ch & 0xff];
+  return To ? To : Ch;
+}
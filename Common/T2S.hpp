@@ -0,0 +1,8 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Traditional to simplified Chinese for one BMP codepoint; other
+// codepoints are returned unchanged. The table is built at compile time,
+// so the result is the same on every platform.
+uint16_t ToSimplified(uint16_t Ch) noexcept;
@@ -0,0 +1,53 @@
+#include "TextColor.hpp"
+
+namespace {
+  struct TextColorDef {
+    wchar_t Code;
+    uint32_t Rgb;
+  };
+
+  // Approximations of the in-game colors
+  constexpr TextColorDef Defs[] = {
+    {L'0', 0xffffff}, // white
+    {L'1', 0xff4d4d}, // red
+    {L'2', 0x00ff00}, // green, set items
+    {L'3', 0x6969ff}, // blue, magic items
+    {L'4', 0xc7b377}, // gold, unique items
+    {L'5', 0x696969}, // gray, socketed items
+    {L'6', 0x000000}, // black
+    {L'7', 0xd0c27d}, // tan
+    {L'8', 0xffa800}, // orange, crafted items
+    {L'9', 0xffff64}, // yellow, rare items
+    {L':', 0x008000}, // dark green
+    {L';', 0xae00ff}, // purple
+  };
+}
+
+TextColors::TextColors(const Palette& Pal) : Luts(size(Defs)) {
+  // Index 0 is transparent, so darks that encode to it take the darkest other
+  auto Darkest = uint8_t{1};
+  for (auto i = 2; i < 256; ++i)
+    if (Pal[i].R + Pal[i].G + Pal[i].B < Pal[Darkest].R + Pal[Darkest].G + Pal[Darkest].B)
+      Darkest = (uint8_t) i;
+  PalEncoder Enc(Pal);
+  for (auto k = size_t{0}; k < size(Defs); ++k) {
+    auto Tint = Pixel(Defs[k].Rgb);
+    auto& Lut = Luts[k];
+    Lut[0] = 0;
+    for (auto i = 1; i < 256; ++i) {
+      auto Pix = Pal[i];
+      Pix.R = (uint8_t) (Pix.R * Tint.R / 255);
+      Pix.G = (uint8_t) (Pix.G * Tint.G / 255);
+      Pix.B = (uint8_t) (Pix.B * Tint.B / 255);
+      auto Idx = Enc.Encode(Pix);
+      Lut[i] = Idx ? Idx : Darkest;
+    }
+  }
+}
+
+const uint8_t* TextColors::Lut(wchar_t Code) const noexcept {
+  for (auto k = size_t{0}; k < size(Defs); ++k)
+    if (Defs[k].Code == Code)
+      return Luts[k].data();
+  return nullptr;
+}
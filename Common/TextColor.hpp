@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "Common.hpp"
+
+// Diablo II text colors, selected in strings by "ÿc" and a code char. Each is
+// a table remapping the indices of white glyphs to the nearest entries of the
+// tinted palette, so colored text is drawn by lookup alone.
+class TextColors {
+public:
+  explicit TextColors(const Palette& Pal);
+
+  // Remap table selected by Code, or nullptr if Code is unknown
+  const uint8_t* Lut(wchar_t Code) const noexcept;
+
+  // Length of the color code at the start of Str, or 0 if there is none
+  static size_t CodeLen(wstring_view Str) noexcept {
+    return Str.size() >= 3 && Str[0] == L'\xff' && Str[1] == L'c' ? 3 : 0;
+  }
+private:
+  vector<array<uint8_t, 256>> Luts; // in the order of the codes
+};
@@ -0,0 +1,95 @@
+#include "ThreadPool.hpp"
+
+#include "MemStats.hpp"
+
+ThreadPool::ThreadPool(size_t NThread) {
+  for (auto i = size_t{1}; i < NThread; ++i)
+    Workers.emplace_back([this] { Work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> Lock(Mtx);
+    Stop = true;
+  }
+  JobCv.notify_all();
+  for (auto& T : Workers)
+    T.join();
+}
+
+void ThreadPool::ParallelFor(size_t N, size_t Chunk, const Body& Fn, size_t MaxSlot) {
+  if (!N)
+    return;
+  if (!Chunk)
+    Chunk = 1;
+  if (!MaxSlot || MaxSlot > NThread())
+    MaxSlot = NThread();
+  Job J;
+  J.Fn = &Fn;
+  J.N = N;
+  J.Chunk = Chunk;
+  J.MaxSlot = MaxSlot;
+#ifdef MEM_STATS
+  J.Phase = MemStats::Global().Current();
+#endif
+  if (MaxSlot == 1 || N <= Chunk) {
+    Run(J, 0);
+    return;
+  }
+  {
+    lock_guard<mutex> Lock(Mtx);
+    Jobs.push_back(&J);
+  }
+  JobCv.notify_all();
+  Run(J, 0);
+  unique_lock<mutex> Lock(Mtx);
+  Jobs.erase(find(Jobs.begin(), Jobs.end(), &J));
+  DoneCv.wait(Lock, [&] { return !J.NActive; });
+}
+
+size_t ThreadPool::DefaultThreads() noexcept {
+  auto N = (size_t) thread::hardware_concurrency();
+  return N ? N : 1;
+}
+
+ThreadPool& ThreadPool::Global() {
+  // Never destroyed: Abort may call exit() from a worker
+  static auto Pool = new ThreadPool(DefaultThreads());
+  return *Pool;
+}
+
+void ThreadPool::Run(Job& J, size_t Slot) {
+#ifdef MEM_STATS
+  MemPhase Phase(J.Phase);
+#endif
+  for (;;) {
+    auto Beg = J.Next.fetch_add(J.Chunk);
+    if (Beg >= J.N)
+      break;
+    (*J.Fn)(Beg, min(Beg + J.Chunk, J.N), Slot);
+  }
+}
+
+ThreadPool::Job* ThreadPool::PickJob() {
+  for (auto J : Jobs)
+    if (J->NextSlot < J->MaxSlot && J->Next.load() < J->N)
+      return J;
+  return nullptr;
+}
+
+void ThreadPool::Work() {
+  unique_lock<mutex> Lock(Mtx);
+  for (;;) {
+    Job* J{};
+    JobCv.wait(Lock, [&] { return Stop || (J = PickJob()); });
+    if (Stop)
+      return;
+    auto Slot = J->NextSlot++;
+    ++J->NActive;
+    Lock.unlock();
+    Run(*J, Slot);
+    Lock.lock();
+    if (!--J->NActive)
+      DoneCv.notify_all();
+  }
+}
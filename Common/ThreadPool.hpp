@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// A fixed set of workers shared by all parallel stages.
+// ParallelFor hands out [Beg, End) chunks from an atomic cursor, so an idle
+// worker keeps pulling chunks from any job that still has some left. The
+// calling thread runs chunks too, which keeps nested calls deadlock-free.
+class ThreadPool {
+public:
+  // Slot is unique among the threads running one ParallelFor call and is
+  // less than its MaxSlot, so it can index per-thread state.
+  using Body = function<void(size_t Beg, size_t End, size_t Slot)>;
+
+  explicit ThreadPool(size_t NThread);
+  ThreadPool(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  ThreadPool& operator =(const ThreadPool&) = delete;
+
+  size_t NThread() const noexcept { return Workers.size() + 1; }
+
+  // MaxSlot limits how many threads may join; 0 means NThread()
+  void ParallelFor(size_t N, size_t Chunk, const Body& Fn, size_t MaxSlot = 0);
+
+  static size_t DefaultThreads() noexcept;
+  static ThreadPool& Global();
+private:
+  struct Job {
+    const Body* Fn;
+    size_t N;
+    size_t Chunk;
+    size_t MaxSlot;
+    atomic<size_t> Next{0};
+    size_t NextSlot{1}; // slot 0 belongs to the caller
+    size_t NActive{0};
+    const char* Phase{}; // the caller's MemPhase, under MEM_STATS
+  };
+
+  static void Run(Job& J, size_t Slot);
+  Job* PickJob();
+  void Work();
+
+  vector<thread> Workers;
+  vector<Job*> Jobs;
+  mutex Mtx;
+  condition_variable JobCv;
+  condition_variable DoneCv;
+  bool Stop{false};
+};
@@ -0,0 +1,183 @@
+#include "Verify.hpp"
+
+#include <stdarg.h>
+
+#include "FontTable.hpp"
+#include "Sprite.hpp"
+
+namespace {
+  constexpr size_t MaxIssues = 20; // per kind and file; the rest are counted
+
+  void AddIssue(vector<string>& To, const char* Fmt, va_list Args) {
+    if (To.size() > MaxIssues)
+      return;
+    if (To.size() == MaxIssues) {
+      To.emplace_back("...");
+      return;
+    }
+    char Buf[256];
+    vsnprintf(Buf, sizeof(Buf), Fmt, Args);
+    To.emplace_back(Buf);
+  }
+
+  template<class T>
+  bool ReadAt(const uint8_t* Data, size_t Size, size_t Off, T& Res) {
+    if (Off > Size || Size - Off < sizeof(T))
+      return false;
+    memcpy(&Res, Data + Off, sizeof(T));
+    return true;
+  }
+
+  // Walks the runs of a frame as ReadDc6Frame would; false on the first
+  // run that ReadDc6Frame would abort on
+  bool CheckRuns(const uint8_t* Ptr, const uint8_t* End, const Dc6FrameHeader& Frm, uint32_t IDir, uint32_t IFrm,
+    AssetReport& Rep) {
+    auto y = (int64_t) Frm.Height - 1;
+    auto x = uint64_t{0};
+    while (Ptr < End) {
+      auto b = *Ptr++;
+      if (b == 0x80) {
+        x = 0;
+        --y;
+      }
+      else if (b & 0x80)
+        x += b & 0x7f;
+      else {
+        if (End - Ptr < b) {
+          Rep.Error("Frame %u/%u ends within a run of %u pixels", IDir, IFrm, b);
+          return false;
+        }
+        if (b && (y < 0 || x + b > Frm.Width)) {
+          Rep.Error("Frame %u/%u draws at (%llu,%lld) outside %ux%u", IDir, IFrm,
+            (unsigned long long) (x + b - 1), (long long) y, Frm.Width, Frm.Height);
+          return false;
+        }
+        Ptr += b;
+        x += b;
+      }
+    }
+    if (y != -1)
+      Rep.Warning("Frame %u/%u ends %lld rows early", IDir, IFrm, (long long) (y + 1));
+    return true;
+  }
+}
+
+void AssetReport::Error(const char* Fmt, ...) {
+  va_list Args;
+  va_start(Args, Fmt);
+  AddIssue(Errors, Fmt, Args);
+  va_end(Args);
+}
+
+void AssetReport::Warning(const char* Fmt, ...) {
+  va_list Args;
+  va_start(Args, Fmt);
+  AddIssue(Warnings, Fmt, Args);
+  va_end(Args);
+}
+
+void VerifyDc6(const uint8_t* Data, size_t Size, AssetReport& Rep) {
+  Dc6Header Hdr;
+  if (!ReadAt(Data, Size, 0, Hdr)) {
+    Rep.Error("%zu bytes are too few for a DC6 header", Size);
+    return;
+  }
+  if (Hdr.Version != 6) {
+    Rep.Error("Version is %u instead of 6", Hdr.Version);
+    return;
+  }
+  if (Hdr.Unk1 != 1)
+    Rep.Warning("Header field at +04 is %u instead of 1", Hdr.Unk1);
+  if (Hdr.Term != 0xeeeeeeee && Hdr.Term != 0xcdcdcdcd)
+    Rep.Warning("Terminator %.8x is neither eeeeeeee nor cdcdcdcd", Hdr.Term);
+  Rep.NDir = Hdr.NDir;
+  Rep.NFrm = Hdr.NFrm;
+  auto NBlock = (uint64_t) Hdr.NDir * Hdr.NFrm;
+  if ((Size - sizeof(Hdr)) / sizeof(uint32_t) < NBlock) {
+    Rep.Error("%u x %u frame offsets do not fit %zu bytes", Hdr.NDir, Hdr.NFrm, Size);
+    return;
+  }
+  auto OffsTable = Data + sizeof(Hdr);
+  auto DataBeg = sizeof(Hdr) + NBlock * sizeof(uint32_t);
+  auto Expected = DataBeg;
+  for (auto i = uint64_t{0}; i < NBlock; ++i) {
+    auto IDir = (uint32_t) (i / Hdr.NFrm), IFrm = (uint32_t) (i % Hdr.NFrm);
+    uint32_t Off;
+    memcpy(&Off, OffsTable + i * sizeof(uint32_t), sizeof(Off));
+    Dc6FrameHeader Frm;
+    if (Off < DataBeg || !ReadAt(Data, Size, Off, Frm)) {
+      Rep.Error("Frame %u/%u is at %u, outside the frame data [%llu, %zu)", IDir, IFrm, Off,
+        (unsigned long long) DataBeg, Size);
+      continue;
+    }
+    if (Off != Expected)
+      Rep.Warning("Frame %u/%u is at %u instead of right after the previous block (%llu)", IDir, IFrm, Off,
+        (unsigned long long) Expected);
+    auto RunsBeg = (uint64_t) Off + sizeof(Frm);
+    if (Size - RunsBeg < Frm.Length) {
+      Rep.Error("Frame %u/%u claims %u bytes but only %llu remain", IDir, IFrm, Frm.Length,
+        (unsigned long long) (Size - RunsBeg));
+      continue;
+    }
+    auto BlockEnd = RunsBeg + Frm.Length + 3;
+    if (Frm.NextBlock != BlockEnd)
+      Rep.Warning("Frame %u/%u: NextBlock is %u, but the data and terminator end at %llu", IDir, IFrm,
+        Frm.NextBlock, (unsigned long long) BlockEnd);
+    if (BlockEnd > Size)
+      Rep.Warning("Frame %u/%u lacks its terminator bytes", IDir, IFrm);
+    if (Frm.Flip > 1)
+      Rep.Warning("Frame %u/%u has flip flag %u", IDir, IFrm, Frm.Flip);
+    if (Frm.Width > 0x10000 || Frm.Height > 0x10000)
+      Rep.Error("Frame %u/%u is %ux%u", IDir, IFrm, Frm.Width, Frm.Height);
+    else {
+      Rep.MaxW = max(Rep.MaxW, Frm.Width);
+      Rep.MaxH = max(Rep.MaxH, Frm.Height);
+      CheckRuns(Data + RunsBeg, Data + RunsBeg + Frm.Length, Frm, IDir, IFrm, Rep);
+    }
+    Expected = BlockEnd;
+  }
+  if (Rep.Errors.empty() && Expected < Size)
+    Rep.Warning("%llu bytes follow the last frame", (unsigned long long) (Size - Expected));
+}
+
+void VerifyTbl(const uint8_t* Data, size_t Size, uint32_t NFrm, AssetReport& Rep) {
+  Rep.IsTbl = true;
+  TblHeader Hdr;
+  if (!ReadAt(Data, Size, 0, Hdr)) {
+    Rep.Error("%zu bytes are too few for a TBL header", Size);
+    return;
+  }
+  if (Hdr.Sign != TblSign) {
+    Rep.Error("Signature is %.8x instead of %.8x", Hdr.Sign, TblSign);
+    return;
+  }
+  if (Hdr.One != 1)
+    Rep.Warning("Header field at +04 is %u instead of 1", Hdr.One);
+  Rep.NChar = Hdr.NChar;
+  Rep.LnSpacing = Hdr.LnSpacing;
+  Rep.CapHeight = Hdr.CapHeight;
+  if (!Hdr.NChar)
+    Rep.Error("No characters");
+  auto Need = sizeof(Hdr) + (size_t) Hdr.NChar * sizeof(TblChar);
+  if (Size < Need) {
+    Rep.Error("%u chars need %zu bytes, but the file has %zu", Hdr.NChar, Need, Size);
+    return;
+  }
+  if (Size > Need)
+    Rep.Warning("%zu bytes follow the last char", Size - Need);
+  if (NFrm && NFrm != Hdr.NChar)
+    Rep.Error("%u chars, but the DC6 has %u frames", Hdr.NChar, NFrm);
+  TblChar Prev{};
+  for (auto i = 0u; i < Hdr.NChar; ++i) {
+    TblChar C;
+    memcpy(&C, Data + sizeof(Hdr) + i * sizeof(TblChar), sizeof(C));
+    if (i && C.Char == Prev.Char)
+      Rep.Error("Char %u appears more than once", C.Char);
+    else if (i && C.Char < Prev.Char)
+      Rep.Error("Char %u follows char %u; the table should be sorted", C.Char, Prev.Char);
+    if (NFrm && C.Dc6Index >= NFrm)
+      Rep.Error("Char %u uses frame %u of %u", C.Char, C.Dc6Index, NFrm);
+    Rep.Chars.Add(C.Char, C.Char);
+    Prev = C;
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include "RangeSet.hpp"
+
+// What VerifyDc6 and VerifyTbl found in one file; errors would make loading
+// it fail, warnings are anomalies the game or the tools tolerate
+struct AssetReport {
+  string Path;
+  bool IsTbl{false};
+  vector<string> Errors;
+  vector<string> Warnings;
+  // DC6
+  uint32_t NDir{};
+  uint32_t NFrm{};
+  uint32_t MaxW{};
+  uint32_t MaxH{};
+  // TBL
+  uint16_t NChar{};
+  uint8_t LnSpacing{};
+  uint8_t CapHeight{};
+  RangeSet Chars;
+
+  void Error(const char* Fmt, ...);
+  void Warning(const char* Fmt, ...);
+};
+
+// Checks the header, offset table, frame blocks and run-length streams of a
+// DC6 in memory without decoding its pixels; never aborts
+void VerifyDc6(const uint8_t* Data, size_t Size, AssetReport& Rep);
+
+// Checks a TBL in memory; NFrm is the frame count of its DC6, 0 if unknown
+void VerifyTbl(const uint8_t* Data, size_t Size, uint32_t NFrm, AssetReport& Rep);
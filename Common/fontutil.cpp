@@ -18,7 +18,7 @@ using ComPtr = Microsoft::WRL::ComPtr<T>;
     }                           \
 } while(0)
 
-HRESULT GetLogFontFromFileName(WCHAR const* fontFileName, LOGFONTW* logFont)
+HRESULT GetLogFontFromFileName(WCHAR const* fontFileName, LOGFONTW* logFont, UINT32 faceIndex)
 {
     // DWrite objects
     ComPtr<IDWriteFactory> dwriteFactory;
@@ -43,6 +43,8 @@ HRESULT GetLogFontFromFileName(WCHAR const* fontFileName, LOGFONTW* logFont)
 
     if (!isSupportedFontType)
         return DWRITE_E_FILEFORMAT;
+    if (faceIndex >= numberOfFaces)
+        return E_INVALIDARG;
 
     // Set up a font face from the array of font files (just one)
     IDWriteFontFile * fontFileArray[] = {fontFile.Get()};
@@ -50,7 +52,7 @@ HRESULT GetLogFontFromFileName(WCHAR const* fontFileName, LOGFONTW* logFont)
             fontFaceType,
             ARRAYSIZE(fontFileArray), // file count
             &fontFileArray[0], // or GetAddressOf if WRL ComPtr
-            0, // faceIndex
+            faceIndex,
             DWRITE_FONT_SIMULATIONS_NONE,
             &fontFace));
 
@@ -4,5 +4,5 @@
 #include "Bitmap.hpp"
 
 bool ttfGetFamilyName(const WCHAR * path, WCHAR name[LF_FACESIZE]);
-HRESULT GetLogFontFromFileName(WCHAR const* fontFileName, LOGFONTW* logFont);
+HRESULT GetLogFontFromFileName(WCHAR const* fontFileName, LOGFONTW* logFont, UINT32 faceIndex = 0);
 bool saveBitmap(const wchar_t * fileName, const Bitmap& bitmap);
@@ -0,0 +1,38 @@
+#include "../Common/Common.hpp"
+#include "../Common/Bitmap.hpp"
+#include "../Common/CompiledFont.hpp"
+#include "../Common/Font.hpp"
+#include "../Common/FontTable.hpp"
+#include "../Common/Sprite.hpp"
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 5) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Compile Font\n"
+      "\n"
+      "Usage: %s <Input>.dc6 <Input>.tbl <Palette>.dat <Output>.d2cf\n"
+      "Decode a DC6/TBL font once into a file that Preview and other tools map\n"
+      "and use in place, with the palette and the palette indices included.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  printf("Reading palette...\n");
+  Palette Pal;
+  Pal.ReadDat(Args[3]);
+  printf("Reading DC6...\n");
+  IndexedSprite Spr;
+  Spr.ReadDc6(Args[1]);
+  printf("Reading TBL...\n");
+  FontTable Tbl;
+  Tbl.ReadTbl(Args[2]);
+  printf("Constructing font...\n");
+  Font Fnt;
+  Fnt.FromSprTbl(Spr, Tbl, Pal);
+  printf("Saving compiled font...\n");
+  CompiledFont::Save(Fnt, Pal, Args[4]);
+  printf("All done\n");
+  return 0;
+}
@@ -0,0 +1,130 @@
+"""Generates HanStandIn.woff2, a stand-in for a CJK font in benchmarks.
+
+Every codepoint of U+4E00-U+9FFF gets an ideograph-like glyph: one to
+three of 512 generated radicals, each 3 to 9 curved strokes, placed side
+by side, stacked or enclosed, as composite glyphs. The shapes are not
+Chinese; they are only meant to cost FreeType about what a Han font
+costs. The output is the same on every run, and is dedicated to the
+public domain (CC0 1.0). Needs fontTools and brotli.
+
+Usage: python GenHanStandIn.py [HanStandIn.woff2]
+"""
+import random
+import sys
+
+from fontTools.fontBuilder import FontBuilder
+from fontTools.misc.timeTools import timestampFromString
+from fontTools.pens.ttGlyphPen import TTGlyphPen
+from fontTools.ttLib.tables._g_l_y_f import GlyphComponent
+
+EM = 1000
+FIRST, LAST = 0x4E00, 0x9FFF
+NRADICAL = 512
+
+
+def stroke(pen, rnd):
+    """Draws one brush stroke inside the em box as a closed curved outline."""
+    kind = rnd.choice("hhhvvvppnd")
+    w = rnd.randint(50, 80)
+    if kind == "h":
+        x0, x1 = rnd.randint(80, 400), rnd.randint(600, 920)
+        y = rnd.randint(120, 860)
+        pts = [(x0, y), (x1, y + rnd.randint(-20, 40))]
+    elif kind == "v":
+        x = rnd.randint(120, 880)
+        y0, y1 = rnd.randint(60, 400), rnd.randint(600, 920)
+        pts = [(x, y1), (x + rnd.randint(-20, 20), y0)]
+    elif kind == "p":
+        x, y = rnd.randint(300, 800), rnd.randint(500, 900)
+        pts = [(x, y), (x - rnd.randint(150, 300), y - rnd.randint(200, 450))]
+    elif kind == "n":
+        x, y = rnd.randint(150, 600), rnd.randint(400, 850)
+        pts = [(x, y), (x + rnd.randint(150, 300), y - rnd.randint(200, 400))]
+    else:
+        x, y = rnd.randint(150, 850), rnd.randint(150, 850)
+        pts = [(x, y), (x + rnd.randint(30, 60), y - rnd.randint(60, 100))]
+    (ax, ay), (bx, by) = pts
+    dx, dy = bx - ax, by - ay
+    length = max(1, (dx * dx + dy * dy) ** 0.5)
+    nx, ny = -dy / length * w / 2, dx / length * w / 2
+    # Swelling middle and rounded ends, as a brush leaves them
+    mx, my = (ax + bx) / 2, (ay + by) / 2
+    bend = rnd.uniform(0.8, 1.3)
+    pen.moveTo((round(ax + nx), round(ay + ny)))
+    pen.qCurveTo((round(mx + nx * bend), round(my + ny * bend)), (round(bx + nx * 0.6), round(by + ny * 0.6)))
+    pen.qCurveTo((round(bx + dx / length * w * 0.5), round(by + dy / length * w * 0.5)),
+                 (round(bx - nx * 0.6), round(by - ny * 0.6)))
+    pen.qCurveTo((round(mx - nx * bend), round(my - ny * bend)), (round(ax - nx), round(ay - ny)))
+    pen.qCurveTo((round(ax - dx / length * w * 0.4), round(ay - dy / length * w * 0.4)),
+                 (round(ax + nx), round(ay + ny)))
+    pen.closePath()
+
+
+def component(name, dx, dy, sx, sy):
+    c = GlyphComponent()
+    c.glyphName = name
+    c.x, c.y = dx, dy
+    c.flags = 0x4  # ROUND_XY_TO_GRID
+    c.transform = [[sx, 0], [0, sy]]
+    return c
+
+
+def main():
+    out = sys.argv[1] if len(sys.argv) > 1 else "HanStandIn.woff2"
+    rnd = random.Random(0x4E00)
+    radicals = ["r%03d" % i for i in range(NRADICAL)]
+    chars = {cp: "uni%04X" % cp for cp in range(FIRST, LAST + 1)}
+    order = [".notdef", "space"] + radicals + list(chars.values())
+
+    fb = FontBuilder(EM, isTTF=True)
+    fb.setupGlyphOrder(order)
+    fb.setupCharacterMap({0x20: "space", **chars})
+    glyphs = {}
+    empty = TTGlyphPen(None)
+    glyphs[".notdef"] = glyphs["space"] = empty.glyph()
+    for name in radicals:
+        pen = TTGlyphPen(None)
+        for _ in range(rnd.randint(3, 9)):
+            stroke(pen, rnd)
+        glyphs[name] = pen.glyph()
+    for cp, name in chars.items():
+        g = TTGlyphPen(None).glyph()
+        g.numberOfContours = -1
+        a, b, c = (rnd.choice(radicals) for _ in range(3))
+        layout = rnd.random()
+        if layout < 0.45:    # left and right
+            split = rnd.choice((0.4, 0.5, 0.6))
+            g.components = [component(a, 20, 0, split * 0.95, 1.0),
+                            component(b, round(EM * split), 0, (1 - split) * 0.95, 1.0)]
+        elif layout < 0.75:  # top and bottom
+            split = rnd.choice((0.4, 0.5, 0.6))
+            g.components = [component(a, 0, round(EM * (1 - split)), 1.0, split * 0.95),
+                            component(b, 0, 0, 1.0, (1 - split) * 0.95)]
+        elif layout < 0.9:   # enclosed
+            g.components = [component(a, 0, 0, 1.0, 1.0), component(b, 200, 200, 0.6, 0.6)]
+        else:                # left, top right and bottom right
+            g.components = [component(a, 20, 0, 0.45, 1.0), component(b, 480, 500, 0.5, 0.48),
+                            component(c, 480, 20, 0.5, 0.48)]
+        glyphs[name] = g
+    fb.setupGlyf(glyphs)
+    glyf = fb.font["glyf"]
+    metrics = {}
+    for name in order:
+        glyf[name].recalcBounds(glyf)
+        metrics[name] = (EM, getattr(glyf[name], "xMin", 0))
+    fb.setupHorizontalMetrics(metrics)
+    fb.setupHorizontalHeader(ascent=880, descent=-120)
+    fb.setupNameTable({"familyName": "Han Stand-In", "styleName": "Regular",
+                       "licenseDescription": "Generated by GenHanStandIn.py; dedicated to the public domain (CC0 1.0)"})
+    fb.setupOS2(sTypoAscender=880, sTypoDescender=-120, usWinAscent=880, usWinDescent=120)
+    fb.setupPost()
+    # Fixed timestamps, so that the output only changes with this script
+    fb.font["head"].created = fb.font["head"].modified = timestampFromString("Mon Jan  1 00:00:00 2024")
+    fb.font.recalcTimestamp = False
+    fb.font.flavor = out.rsplit(".", 1)[-1] if out.endswith((".woff", ".woff2")) else None
+    fb.save(out)
+    print("%d glyphs written to %s" % (len(order), out))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,8 +1,19 @@
 #include "../Common/Common.hpp"
+#include "../Common/Corpus.hpp"
+#include "../Common/FileWatch.hpp"
 #include "../Common/Font.hpp"
+#include "../Common/GlyphCache.hpp"
+#include "../Common/Hash.hpp"
+#include "../Common/MemStats.hpp"
+#include "../Common/Process.hpp"
+#include "../Common/RangeSet.hpp"
+#include "../Common/ThreadPool.hpp"
 
 #include "rapidjson/document.h"
 
+#include <chrono>
+#include <filesystem>
+#include <optional>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -21,27 +32,685 @@ T Parse(const char* S, const char* Desc) {
   return Cast<T>(Res, "The %s is too large (%" PRIuMAX ")", Desc, Res);
 }
 
+// Time spent on one DC6/TBL pair
+struct Report {
+  string dc6Path;
+  uint32_t size;
+  size_t nGlyph;
+  double ms;
+};
+
+// Stages of a target's build, in order
+enum class Stage { render, layout, dump };
+
+struct BuildOptions {
+  GlyphCache* cache{nullptr}; // used instead of the config's glyphCache
+  bool skipUnchanged{false};  // on top of the config's skipUnchanged
+  bool writeDc6{true};        // false when only TBL values changed
+  // One font per target, kept laid out (see Font::KeepGlyphs) so that the
+  // next Build can start at a later stage; refilled when it cannot
+  vector<unique_ptr<Font>>* fonts{nullptr};
+  Stage from{Stage::render};  // with fonts, the first stage to redo
+};
+
+// Builds every target of one config
+static vector<Report> Build(const rapidjson::Value& d, const BuildOptions& opts) {
+  auto HeightConstant = d["leadingfactor"].GetInt();
+  auto LnSpacingOff = d["LeadingOffset"].GetInt();
+  auto CapHeight = d["CapHeight"].GetInt();
+  auto OriginOffset = d["OriginOffset"].GetInt();
+  auto DescentPadding = d["DescentPadding"].GetInt();
+  auto PalPath = d["pal"].GetString();
+
+  // Keep only the chars the game text uses, plus the allow-list: strings of
+  // chars or [first, last] ranges, which still have to be in the partitions
+  auto hasCorpus = d.HasMember("corpus");
+  CharSet used;
+  if (hasCorpus) {
+    vector<string> paths;
+    for (auto v = d["corpus"].Begin(); v != d["corpus"].End(); ++v)
+      paths.emplace_back(v->GetString());
+    printf("Scanning corpus...\n");
+    used = ScanCorpus(paths);
+    if (d.HasMember("allow"))
+      for (auto v = d["allow"].Begin(); v != d["allow"].End(); ++v) {
+        if (v->IsString())
+          ScanText((const uint8_t*) v->GetString(), v->GetStringLength(), used);
+        else
+          for (auto i = (*v)[0].GetUint(); i <= (*v)[1].GetUint() && i < used.size(); i++)
+            used.set(i);
+      }
+  }
+
+  // Traditional chars are rendered from simplified glyphs unless disabled
+  auto simplified = d.HasMember("simplified") ? d["simplified"].GetBool() : true;
+  // "gdi" rasterizes through Windows, "freetype" renders on all cores
+  string engine = d.HasMember("engine") ? d["engine"].GetString() : "gdi";
+  if (engine != "gdi" && engine != "freetype")
+    Abort("Unknown engine: %s", engine.c_str());
+#ifndef _WIN32
+  if (engine == "gdi")
+    Abort("The gdi engine needs Windows");
+#endif
+  auto threads = d.HasMember("threads") ? d["threads"].GetUint() : 0u;
+  auto gamma = d.HasMember("gamma") ? d["gamma"].GetBool() : true;
+  // Render every glyph once at this size and scale it to each target size
+  auto sdfSize = d.HasMember("sdfSize") ? d["sdfSize"].GetUint() : 0u;
+  if (sdfSize && engine != "freetype")
+    Abort("sdfSize needs the freetype engine");
+  // Effects on the rendered coverage; colors are [r, g, b]
+  auto colorOf = [](const rapidjson::Value& c) {
+    return Pixel((uint8_t) c[0].GetInt(), (uint8_t) c[1].GetInt(), (uint8_t) c[2].GetInt());
+  };
+  auto color = [&](const char* key, Pixel def) {
+    return d.HasMember(key) ? colorOf(d[key]) : def;
+  };
+  GlyphEffects effects;
+  if (d.HasMember("sharpeningLevel") && !d["sharpeningLevel"].IsNull())
+    effects.Sharpen = d["sharpeningLevel"].GetUint();
+  if (d.HasMember("outline"))
+    effects.Outline = d["outline"].GetUint();
+  if (d.HasMember("shadow")) {
+    effects.ShadowX = d["shadow"][0].GetInt();
+    effects.ShadowY = d["shadow"][1].GetInt();
+  }
+  effects.OutlineCol = color("outlineColor", effects.OutlineCol);
+  effects.ShadowCol = color("shadowColor", effects.ShadowCol);
+  auto glyphColor = color("glyphColor", Pixel(255, 255, 255));
+  if ((!effects.Empty() || glyphColor.Rgb() != 0xffffff) && engine != "freetype")
+    Abort("Glyph effects and colors need the freetype engine");
+
+  // Each partition renders its ranges with its own face, size and style, as
+  // partitonConfig in config.yaml; without "partitions" the top-level path,
+  // size, aa and ranges make the only one. A char listed by several
+  // partitions belongs to the first.
+  struct Partition {
+    RangeSet chars;
+    string face;
+    uint16_t size;
+    bool aa;
+    Pixel color;
+    uint8_t unkTwo;
+  };
+  // Each entry of a ranges array holds one [first, last] member, whatever its name
+  auto addRanges = [](const rapidjson::Value& h, RangeSet& set) {
+    for (auto v = h.Begin(); v != h.End(); ++v)
+      if (v->MemberBegin() != v->MemberEnd())
+        set.Add(v->MemberBegin()->value[0].GetUint(), v->MemberBegin()->value[1].GetUint());
+  };
+  vector<Partition> partitions;
+  if (d.HasMember("partitions")) {
+    if (engine != "freetype")
+      Abort("partitions need the freetype engine");
+    for (auto v = d["partitions"].Begin(); v != d["partitions"].End(); ++v) {
+      auto& p = *v;
+      Partition part;
+      if (p.HasMember("start"))
+        part.chars.Add(p["start"].GetUint(), p["end"].GetUint());
+      if (p.HasMember("ranges"))
+        addRanges(p["ranges"], part.chars);
+      part.face = p["fontFace"].GetString();
+      part.size = (uint16_t) p["size"].GetUint();
+      part.aa = p.HasMember("aa") ? p["aa"].GetBool() : true;
+      part.color = p.HasMember("glyphColor") ? colorOf(p["glyphColor"]) : glyphColor;
+      part.unkTwo = p.HasMember("tblUnknownValueTwo") ? (uint8_t) p["tblUnknownValueTwo"].GetUint() : 1;
+      partitions.push_back(move(part));
+    }
+    if (partitions.empty())
+      Abort("No partitions given");
+  } else {
+    Partition part;
+    addRanges(d["ranges"], part.chars);
+    part.face = d["path"].GetString();
+    part.size = (uint16_t) d["size"].GetInt();
+    part.aa = d["aa"].GetBool();
+    part.color = glyphColor;
+    part.unkTwo = 1;
+    partitions.push_back(move(part));
+  }
+  RangeSet taken;
+  auto nChar = size_t{0}, nKept = size_t{0};
+  for (auto& p : partitions) {
+    p.chars.Subtract(taken);
+    taken.Add(p.chars);
+    nChar += p.chars.Count();
+    for (auto [first, last] : p.chars.Ranges())
+      for (auto ch = first; ch <= last && ch < used.size(); ch++)
+        nKept += used[ch];
+  }
+  if (hasCorpus)
+    printf("Corpus keeps %zu of %zu chars\n", nKept, nChar);
+
+  // One DC6/TBL pair per size; "sizes" replaces size/dc6name/tblname
+  struct Target {
+    uint16_t Size;
+    string Dc6Path;
+    string TblPath;
+  };
+  vector<Target> targets;
+  if (d.HasMember("sizes")) {
+    for (auto v = d["sizes"].Begin(); v != d["sizes"].End(); ++v)
+      targets.push_back({(uint16_t) (*v)["size"].GetInt(), (*v)["dc6name"].GetString(), (*v)["tblname"].GetString()});
+  } else {
+    targets.push_back({partitions[0].size, d["dc6name"].GetString(), d["tblname"].GetString()});
+  }
+
+  // Report the TBL header values from glyph metrics instead of rendering
+  auto dryRun = d.HasMember("dryRun") ? d["dryRun"].GetBool() : false;
+  // Pick the largest size whose glyphs fit this line spacing
+  auto fitLnSpacing = d.HasMember("fitLnSpacing") ? d["fitLnSpacing"].GetUint() : 0u;
+  if ((dryRun || fitLnSpacing) && engine != "freetype")
+    Abort("dryRun and fitLnSpacing need the freetype engine");
+  if (fitLnSpacing && partitions.size() > 1)
+    Abort("fitLnSpacing needs a single partition");
+  // Rasterized glyphs are kept here across runs
+  GlyphCache ownCache;
+  auto cache = opts.cache;
+  if (!cache && d.HasMember("glyphCache")) {
+    if (engine != "freetype")
+      Abort("glyphCache needs the freetype engine");
+    ownCache.Open(d["glyphCache"].GetString());
+    cache = &ownCache;
+  }
+  // Kept fonts are reused for the same targets, if they were rendered
+  auto reuse = opts.fonts && opts.from != Stage::render && opts.fonts->size() == targets.size() &&
+    engine == "freetype" && !dryRun;
+  if (opts.fonts && !reuse) {
+    opts.fonts->clear();
+    opts.fonts->resize(targets.size());
+  }
+  // Leave outputs whose bytes would not change untouched
+  auto skipUnchanged = opts.skipUnchanged || (d.HasMember("skipUnchanged") && d["skipUnchanged"].GetBool());
+  auto save = [&](const string& path, auto&& write) {
+    if (!skipUnchanged) {
+      write(path.c_str());
+      return;
+    }
+    auto tmp = path + ".tmp";
+    write(tmp.c_str());
+    if (!ReplaceIfChanged(tmp.c_str(), path.c_str()))
+      printf("%s is unchanged\n", path.c_str());
+  };
+  //int bg = d["bgColor"][0].GetInt();
+
+  printf("Reading palette...\n");
+  Palette Pal;
+  Pal.ReadDat(PalPath);
+  // Returns how many glyphs the target has
+  auto buildTarget = [&](size_t targetIdx) {
+    auto& t = targets[targetIdx];
+    unique_ptr<Font> own;
+    auto& kept = opts.fonts ? (*opts.fonts)[targetIdx] : own;
+    if (!reuse)
+      kept = make_unique<Font>();
+    auto& Fnt = *kept;
+    auto nGlyph = size_t{0};
+    auto phase = optional<MemPhase>(in_place, "prepare");
+    Fnt.HeightConstant = HeightConstant;
+    Fnt.LnSpacingOff = LnSpacingOff;
+    Fnt.CapHeight = CapHeight;
+    Fnt.OriginOffset = OriginOffset;
+    Fnt.DescentPadding = DescentPadding;
+    if (reuse) {
+      for (auto& G : Fnt.Glyphs)
+        nGlyph += G != nullptr;
+      if (opts.from == Stage::layout) {
+        printf("Laying out glyphs (size %u)...\n", t.Size);
+        phase.emplace("layout");
+        // Recomputed from the glyphs, as in the first build
+        Fnt.LnSpacing = 0;
+        Fnt.Relayout();
+      }
+    } else {
+      printf("Preparing glyphs (size %u)...\n", t.Size);
+      Fnt.Size = t.Size;
+      Fnt.KeepGlyphs = opts.fonts != nullptr;
+      Fnt.Simplify = simplified;
+      Fnt.Gamma = gamma;
+      Fnt.NThread = threads;
+      Fnt.SdfSize = sdfSize;
+      Fnt.Effects = effects;
+      Fnt.Cache = cache;
+      // Partition i renders with face i; other targets scale every partition
+      // by their size over the first partition's
+      for (auto& p : partitions)
+        Fnt.Faces.emplace_back(p.face);
+      // Faces tried in order for chars the main face lacks (freetype engine)
+      if (d.HasMember("fallbacks"))
+        for (auto v = d["fallbacks"].Begin(); v != d["fallbacks"].End(); ++v) {
+          Fnt.Fallbacks.push_back((int32_t) Fnt.Faces.size());
+          Fnt.Faces.emplace_back(v->GetString());
+        }
+      for (auto i = size_t{0}; i < partitions.size(); i++) {
+        auto& p = partitions[i];
+        auto size = max(1u, (p.size * t.Size + partitions[0].size / 2u) / partitions[0].size);
+        for (auto [first, last] : p.chars.Ranges())
+          for (auto ch = first; ch <= last && ch < Fnt.Glyphs.size(); ch++) {
+            if (hasCorpus && !used[ch])
+              continue;
+            auto& G = Fnt.Glyphs[ch];
+            G.reset(new FontGlyph);
+            G->Char = (uint16_t) ch;
+            G->AntiAliasing = p.aa;
+            G->FgCol = p.color;
+            G->UnkTwo = p.unkTwo;
+            G->Size = size;
+            G->FaceIdx = (int32_t) i;
+            G->HasBmp = false;
+            nGlyph++;
+          }
+      }
+      if (fitLnSpacing) {
+        printf("Fitting size to line spacing %u...\n", fitLnSpacing);
+        auto fitted = Fnt.FitSize(fitLnSpacing, 1, max<uint32_t>(t.Size, fitLnSpacing) * 2);
+        printf("Fitted size: %u\n", fitted);
+      }
+      if (dryRun) {
+        auto m = Fnt.MeasureGlyphs();
+        printf("LnSpacing %u, CapHeight %u, UnkHZ %u\n",
+          Fnt.LnSpacing ? Fnt.LnSpacing : m.LnSpacing, m.CapHeight, Fnt.UnkHZ);
+        printf("MaxH %zu, MaxDescent %d, Actual Spacing %u\n", m.MaxH, m.MaxDescent, m.ActualSpacing);
+        if (!m.Overflow.empty()) {
+          printf("%zu chars are taller than Actual Spacing:", m.Overflow.size());
+          for (auto i = size_t{0}; i < m.Overflow.size() && i < 32; ++i)
+            printf(" 0x%04x", m.Overflow[i]);
+          printf(m.Overflow.size() > 32 ? " ...\n" : "\n");
+        }
+        return nGlyph;
+      }
+      printf("Rendering glyphs...\n");
+      phase.emplace("render");
+      if (engine == "freetype")
+        Fnt.RenderGlyphs();
+#ifdef _WIN32
+      else {
+        // GDI keeps process-wide state, so one target renders through it at a time
+        static mutex gdiMtx;
+        lock_guard<mutex> lock(gdiMtx);
+        Fnt.RenderGlyphsGDI(t.Size);
+      }
+#endif
+    }
+    printf("Dumping font...\n");
+    phase.emplace("dump");
+    Sprite Spr;
+    FontTable Tbl;
+    Fnt.Dump(Spr, Tbl);
+    if (opts.writeDc6) {
+      printf("Saving DC6...\n");
+      phase.emplace("save");
+      save(t.Dc6Path, [&](const char* path) { Spr.SaveDc6(path, Pal); });
+    }
+    printf("Saving TBL...\n");
+    save(t.TblPath, [&](const char* path) { Tbl.SaveTbl(path); });
+    return nGlyph;
+  };
+  // Targets share the pool with the glyphs they render
+  vector<Report> reports(targets.size());
+  ThreadPool::Global().ParallelFor(targets.size(), 1, [&](size_t beg, size_t end, size_t) {
+    for (auto i = beg; i < end; i++) {
+      auto start = chrono::steady_clock::now();
+      auto nGlyph = buildTarget(i);
+      auto ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+      printf("Finished %s in %.0f ms\n", targets[i].Dc6Path.c_str(), ms);
+      reports[i] = {targets[i].Dc6Path, targets[i].Size, nGlyph, ms};
+    }
+  });
+  if (cache == &ownCache) {
+    printf("Glyph cache: %zu hits, %zu misses\n", ownCache.NHit(), ownCache.NMiss());
+    ownCache.Save();
+  }
+  return reports;
+}
+
+static void PrintReports(const vector<Report>& reports) {
+  printf("%-32s %5s %7s %10s\n", "Target", "Size", "Glyphs", "Time (ms)");
+  for (auto& r : reports)
+    printf("%-32s %5u %7zu %10.0f\n", r.dc6Path.c_str(), r.size, r.nGlyph, r.ms);
+}
+
+// Reads a JSON file into d; false if it cannot be opened
+static bool ReadJson(const string& path, rapidjson::Document& d) {
+  ifstream in(path, ios::in);
+  if (!in)
+    return false;
+  istreambuf_iterator<char> beg(in), end;
+  string json(beg, end);
+  d.Parse(json.c_str());
+  return true;
+}
+
+// Rebuilds whenever the config or its palette changes. Faces, charmaps,
+// rendered glyphs and palette lookups stay in memory, and so does each
+// target's laid out font (freetype engine): a padding or spacing change only
+// lays the glyphs out again, and a palette change only saves them again. A
+// config diff that only touches TBL values skips the DC6, and unchanged
+// outputs are left alone. Font files are loaded once, so replacing one needs
+// a restart.
+static int Watch(const string& path, rapidjson::Document& d) {
+  static const char* const tblKeys[] = {"LeadingOffset", "leadingfactor", "CapHeight"};
+  static const char* const layoutKeys[] = {"LeadingOffset", "leadingfactor", "CapHeight", "OriginOffset",
+    "DescentPadding", "pal"};
+  GlyphCache cache;
+  if (d.HasMember("glyphCache"))
+    cache.Open(d["glyphCache"].GetString());
+  vector<unique_ptr<Font>> fonts;
+  BuildOptions opts;
+  opts.cache = &cache;
+  opts.skipUnchanged = true;
+  opts.fonts = &fonts;
+  PrintReports(Build(d, opts));
+  cache.Save();
+  FileWatch watch;
+  watch.Add(path);
+  string palPath = d["pal"].GetString();
+  if (palPath != "null")
+    watch.Add(palPath);
+  for (;;) {
+    printf("Watching %s for changes...\n", path.c_str());
+    auto changed = watch.Wait();
+    auto palChanged = find(changed.begin(), changed.end(), palPath) != changed.end();
+    rapidjson::Document next;
+    if (!ReadJson(path, next) || next.HasParseError() || !next.HasMember("filename")) {
+      Warn("%s is not a valid config, keeping the last build", path.c_str());
+      continue;
+    }
+    // Top-level keys added, removed or changed
+    vector<string> keys;
+    for (auto m = next.MemberBegin(); m != next.MemberEnd(); ++m)
+      if (!d.HasMember(m->name.GetString()) || d[m->name.GetString()] != m->value)
+        keys.emplace_back(m->name.GetString());
+    for (auto m = d.MemberBegin(); m != d.MemberEnd(); ++m)
+      if (!next.HasMember(m->name.GetString()))
+        keys.emplace_back(m->name.GetString());
+    if (keys.empty() && !palChanged)
+      continue;
+    printf("Changed:%s", palChanged ? " palette" : "");
+    for (auto& k : keys)
+      printf(" %s", k.c_str());
+    printf("\n");
+    auto allIn = [&](const auto& allowed) {
+      return all_of(keys.begin(), keys.end(), [&](const string& k) {
+        return any_of(begin(allowed), end(allowed), [&](const char* a) { return k == a; });
+      });
+    };
+    opts.writeDc6 = palChanged || !allIn(tblKeys);
+    opts.from = all_of(keys.begin(), keys.end(), [](const string& k) { return k == "pal"; }) ? Stage::dump :
+      allIn(layoutKeys) ? Stage::layout : Stage::render;
+    auto start = chrono::steady_clock::now();
+    PrintReports(Build(next, opts));
+    cache.Save();
+    printf("Rebuilt in %.0f ms\n", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    string nextPal = next["pal"].GetString();
+    if (nextPal != palPath && nextPal != "null")
+      watch.Add(nextPal);
+    palPath = nextPal;
+    d.Swap(next);
+  }
+}
+
+// JSON string body
+static string Escape(const string& str) {
+  string res;
+  for (auto ch : str) {
+    if (ch == '"' || ch == '\\')
+      res += '\\';
+    if ((unsigned char) ch >= 0x20)
+      res += ch;
+  }
+  return res;
+}
+
+static string HexOf(uint64_t hash) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016" PRIx64, hash);
+  return buf;
+}
+
+// What one golden case produced and took
+struct GoldenResult {
+  string name;
+  vector<pair<string, uint64_t>> hashes; // output path, hash
+  double ms;                             // fastest build
+  size_t peakBytes;                      // highest peak of the builds
+  bool built;
+  bool skipped;                          // a gdi case off Windows
+};
+
+// Renders text with the built font and saves it as png. The hash is of the
+// size and pixels, so it does not depend on how the PNG is compressed.
+static uint64_t HashPreview(const string& dc6Path, const string& tblPath, const char* palPath, const wstring& text,
+  const string& png) {
+  Palette pal;
+  pal.ReadDat(palPath);
+  Sprite spr;
+  spr.ReadDc6(dc6Path.c_str(), pal);
+  FontTable tbl;
+  tbl.ReadTbl(tblPath.c_str());
+  Font fnt;
+  fnt.FromSprTbl(spr, tbl);
+  auto bmp = fnt.Render(text);
+  if (bmp.Count())
+    bmp.SavePng(png.c_str());
+  uint64_t dims[]{bmp.Width(), bmp.Height()};
+  return Hash64(bmp.Raw(), bmp.Count() * sizeof(Pixel), Hash64(dims, sizeof(dims)));
+}
+
+// Builds each case of a golden manifest in a child process, "repeat" times,
+// and compares the DC6/TBL bytes and preview pixels with the hashes of the
+// baseline. Only if the manifest gives "timeTolerance" or "memoryTolerance"
+// are the fastest time or highest peak memory checked against the
+// baseline's too, since they only compare on the machine that recorded it.
+// With update, the baseline is rewritten from this run instead. Cases run one at a time so they do not
+// skew each other's time. Cases on the gdi engine need Windows; elsewhere
+// they are skipped, and update keeps their baseline entries as they were.
+static int Golden(const char* exe, const rapidjson::Document& d, bool update) {
+  auto baselinePath = d["baseline"].GetString();
+  auto repeat = max(1u, d.HasMember("repeat") ? d["repeat"].GetUint() : 3u);
+  auto checkTime = d.HasMember("timeTolerance");
+  auto timeTolerance = checkTime ? d["timeTolerance"].GetDouble() : 0.0;
+  auto checkMemory = d.HasMember("memoryTolerance");
+  auto memoryTolerance = checkMemory ? d["memoryTolerance"].GetDouble() : 0.0;
+  rapidjson::Document baseline;
+  auto hasBaseline = ReadJson(baselinePath, baseline) && !baseline.HasParseError();
+  if (!update && !hasBaseline)
+    Abort("No baseline at %s, run with --update to record one", baselinePath);
+  auto baselineOf = [&](const string& name) -> const rapidjson::Value* {
+    if (hasBaseline)
+      for (auto v = baseline["cases"].Begin(); v != baseline["cases"].End(); ++v)
+        if (name == (*v)["name"].GetString())
+          return &*v;
+    return nullptr;
+  };
+
+  vector<GoldenResult> results;
+  auto nFail = size_t{0};
+  for (auto c = d["cases"].Begin(); c != d["cases"].End(); ++c) {
+    auto& r = results.emplace_back();
+    r.name = (*c)["name"].GetString();
+    string configPath = (*c)["config"].GetString();
+    rapidjson::Document config;
+    if (!ReadJson(configPath, config) || !config.HasMember("filename"))
+      Abort("Invalid config: %s", configPath.c_str());
+#ifndef _WIN32
+    // Build defaults to the gdi engine too
+    if (string(config.HasMember("engine") ? config["engine"].GetString() : "gdi") == "gdi") {
+      printf("SKIP %s: the gdi engine needs Windows\n", r.name.c_str());
+      r.skipped = true;
+      continue;
+    }
+#endif
+    printf("Building %s...\n", r.name.c_str());
+    r.built = true;
+    for (auto i = 0u; i < repeat && r.built; i++) {
+      auto stats = RunProcess({exe, configPath});
+      r.built = !stats.ExitCode;
+      r.ms = i ? min(r.ms, stats.Ms) : stats.Ms;
+      r.peakBytes = max(r.peakBytes, stats.PeakBytes);
+    }
+    if (!r.built) {
+      printf("FAIL %s: the build failed\n", r.name.c_str());
+      nFail++;
+      continue;
+    }
+
+    vector<pair<string, string>> outputs;
+    if (config.HasMember("sizes"))
+      for (auto v = config["sizes"].Begin(); v != config["sizes"].End(); ++v)
+        outputs.emplace_back((*v)["dc6name"].GetString(), (*v)["tblname"].GetString());
+    else
+      outputs.emplace_back(config["dc6name"].GetString(), config["tblname"].GetString());
+    wstring preview;
+    if (c->HasMember("preview"))
+      DecodeText((const uint8_t*) (*c)["preview"].GetString(), (*c)["preview"].GetStringLength(), preview);
+    for (auto& [dc6Path, tblPath] : outputs) {
+      r.hashes.emplace_back(dc6Path, HashFile(dc6Path.c_str()));
+      r.hashes.emplace_back(tblPath, HashFile(tblPath.c_str()));
+      if (!preview.empty()) {
+        auto png = filesystem::path(dc6Path).replace_extension(".preview.png").string();
+        r.hashes.emplace_back(png, HashPreview(dc6Path, tblPath, config["pal"].GetString(), preview, png));
+      }
+    }
+    if (update)
+      continue;
+
+    auto golden = baselineOf(r.name);
+    if (!golden) {
+      printf("FAIL %s: not in the baseline\n", r.name.c_str());
+      nFail++;
+      continue;
+    }
+    auto ok = true;
+    for (auto& [path, hash] : r.hashes) {
+      auto& o = (*golden)["outputs"];
+      auto expected = o.HasMember(path.c_str()) ? o[path.c_str()].GetString() : "none";
+      if (HexOf(hash) != expected) {
+        printf("FAIL %s: %s hashes to %s instead of %s\n", r.name.c_str(), path.c_str(), HexOf(hash).c_str(), expected);
+        ok = false;
+      }
+    }
+    auto goldenMs = (*golden)["ms"].GetDouble();
+    if (checkTime && r.ms > goldenMs * (1 + timeTolerance)) {
+      printf("FAIL %s: %.0f ms, baseline %.0f ms\n", r.name.c_str(), r.ms, goldenMs);
+      ok = false;
+    }
+    auto goldenPeak = (*golden)["peakBytes"].GetUint64();
+    if (checkMemory && (double) r.peakBytes > (double) goldenPeak * (1 + memoryTolerance)) {
+      printf("FAIL %s: peak %.1f MB, baseline %.1f MB\n", r.name.c_str(), r.peakBytes / 1048576.0, goldenPeak / 1048576.0);
+      ok = false;
+    }
+    nFail += !ok;
+  }
+
+  printf("%-24s %10s %12s\n", "Case", "Time (ms)", "Peak (MB)");
+  for (auto& r : results)
+    if (r.skipped)
+      printf("%-24s %10s %12s\n", r.name.c_str(), "skipped", "skipped");
+    else
+      printf("%-24s %10.0f %12.1f\n", r.name.c_str(), r.ms, r.peakBytes / 1048576.0);
+  auto nSkip = (size_t) count_if(results.begin(), results.end(), [](const GoldenResult& r) { return r.skipped; });
+  if (update) {
+    if (any_of(results.begin(), results.end(), [](const GoldenResult& r) { return !r.built && !r.skipped; }))
+      Abort("Not updating %s while a case fails to build", baselinePath);
+    // Skipped cases keep what the baseline had for them, if anything
+    for (auto& r : results) {
+      auto golden = r.skipped ? baselineOf(r.name) : nullptr;
+      if (!golden)
+        continue;
+      r.ms = (*golden)["ms"].GetDouble();
+      r.peakBytes = (size_t) (*golden)["peakBytes"].GetUint64();
+      auto& o = (*golden)["outputs"];
+      for (auto m = o.MemberBegin(); m != o.MemberEnd(); ++m)
+        r.hashes.emplace_back(m->name.GetString(), strtoull(m->value.GetString(), nullptr, 16));
+      r.skipped = false;
+    }
+    auto file = AutoFile(baselinePath, "wb");
+    fprintf(file.Raw(), "{\n  \"cases\": [");
+    auto first = true;
+    for (auto& r : results) {
+      if (r.skipped)
+        continue;
+      fprintf(file.Raw(), "%s\n    {\"name\": \"%s\", \"ms\": %.1f, \"peakBytes\": %zu, \"outputs\": {", first ? "" : ",",
+        Escape(r.name).c_str(), r.ms, r.peakBytes);
+      first = false;
+      for (auto j = size_t{0}; j < r.hashes.size(); j++)
+        fprintf(file.Raw(), "%s\n      \"%s\": \"%s\"", j ? "," : "", Escape(r.hashes[j].first).c_str(),
+          HexOf(r.hashes[j].second).c_str());
+      fprintf(file.Raw(), "\n    }}");
+    }
+    fprintf(file.Raw(), "\n  ]\n}\n");
+    printf("Baseline written to %s\n", baselinePath);
+    return 0;
+  }
+  if (nFail)
+    printf("%zu of %zu cases failed\n", nFail, results.size() - nSkip);
+  else
+    printf("All %zu cases match the baseline\n", results.size() - nSkip);
+  if (nSkip)
+    printf("%zu cases skipped\n", nSkip);
+  return nFail ? EXIT_FAILURE : 0;
+}
+
 int main(int NArg, char* Args[]) {
     string jsonname = "config.json";
     if (NArg > 1) {
         jsonname = Args[1];
         fprintf(stdout, "%s specified.\n", Args[1]);
     };
+    auto watchMode = NArg > 2 && !strcmp(Args[2], "--watch");
+    auto goldenMode = NArg > 2 && !strcmp(Args[2], "--golden");
+    auto update = goldenMode && NArg > 3 && !strcmp(Args[3], "--update");
 
-    // dirty open a file in main
-    ifstream in(jsonname, ios::in);
-    if (!in)
+    // shitty json lib here
+    rapidjson::Document d;
+    if (!ReadJson(jsonname, d))
     {
         cerr << "Error opening file" << endl;
         return EXIT_FAILURE;
     }
-    istreambuf_iterator<char> beg(in), end;
-    string json(beg, end);
-    in.close();
 
-    // shitty json lib here
-    rapidjson::Document d;
-    d.Parse(json.c_str());
+  if (goldenMode) {
+    if (!d.HasMember("cases") || !d.HasMember("baseline"))
+      Abort("%s is not a golden manifest", jsonname.c_str());
+    return Golden(Args[0], d, update);
+  }
+
+  // A manifest lists configs built together in this process, sharing the
+  // pool, the font, charmap, palette and (if given) glyph caches
+  if (d.HasMember("configs")) {
+    if (watchMode)
+      Abort("--watch takes a single config, not a manifest");
+    vector<string> paths;
+    for (auto v = d["configs"].Begin(); v != d["configs"].End(); ++v)
+      paths.emplace_back(v->GetString());
+    GlyphCache cache;
+    if (d.HasMember("glyphCache"))
+      cache.Open(d["glyphCache"].GetString());
+    auto start = chrono::steady_clock::now();
+    vector<vector<Report>> reports(paths.size());
+    ThreadPool::Global().ParallelFor(paths.size(), 1, [&](size_t beg, size_t end, size_t) {
+      for (auto i = beg; i < end; i++) {
+        rapidjson::Document config;
+        if (!ReadJson(paths[i], config) || !config.HasMember("filename"))
+          Abort("Invalid config: %s", paths[i].c_str());
+        BuildOptions opts;
+        opts.cache = d.HasMember("glyphCache") ? &cache : nullptr;
+        reports[i] = Build(config, opts);
+      }
+    });
+    vector<Report> all;
+    for (auto& r : reports)
+      all.insert(all.end(), r.begin(), r.end());
+    PrintReports(all);
+    printf("%zu configs in %.0f ms\n", paths.size(),
+      chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    if (d.HasMember("glyphCache")) {
+      printf("Glyph cache: %zu hits, %zu misses\n", cache.NHit(), cache.NMiss());
+      cache.Save();
+    }
+    printf("All done\n");
+    return 0;
+  }
 
     if (!d.HasMember("filename")) {
         fprintf(stderr, "Invalid json.\n");
@@ -52,78 +721,19 @@ int main(int NArg, char* Args[]) {
             "Usage: %s **params moved to json**\n"
             "Construct DC6 and TBL file using the specified font face and point size.\n"
             "Note: The font must be supported by FreeType.\n"
-            "Use null as the palatte to encode as grayscale images.\n",
+            "Use null as the palatte to encode as grayscale images.\n"
+            "A manifest {\"configs\": [...], \"glyphCache\": ...} builds several configs in one process.\n"
+            "Pass --watch after the config to rebuild it whenever it changes.\n"
+            "Pass --golden after a manifest {\"cases\": [...], \"baseline\": ...} to build each case and\n"
+            "check its outputs against the baseline, and its time and memory if the manifest gives\n"
+            "\"timeTolerance\" or \"memoryTolerance\"; --update records it.\n",
             Args[0]
         );
         return EXIT_FAILURE;
     }
-  Font Fnt;
-
-  auto FacePath = d["path"].GetString();
-  uint16_t Size = d["size"].GetInt();
-  auto HeightConstant = d["leadingfactor"].GetInt();
-  auto LnSpacingOff = d["LeadingOffset"].GetInt();
-  auto CapHeight = d["CapHeight"].GetInt();
-  auto OriginOffset = d["OriginOffset"].GetInt();
-  auto DescentPadding = d["DescentPadding"].GetInt();
-  auto PalPath = d["pal"].GetString();
-  auto Dc6Path = d["dc6name"].GetString();
-  auto TblPath = d["tblname"].GetString();
-
-  // Build a list with your free-to-waste RAM
-  vector<uint16_t> glyphlist;
-
-  // Juse werk snippet for parsing ranges
-  const rapidjson::Value& h = d["ranges"];
-  for (rapidjson::Value::ConstValueIterator v_iter = h.Begin();
-      v_iter != h.End(); ++v_iter)
-  {
-      const rapidjson::Value& field = *v_iter;
-      for (rapidjson::Value::ConstMemberIterator m_iter = field.MemberBegin();
-          m_iter != field.MemberEnd(); ++m_iter)
-      {
-          auto start = m_iter->value[0].GetInt();
-          auto end = m_iter->value[1].GetInt();
-          for (auto i = (unsigned) start; i <= (unsigned) end; i++)
-              glyphlist.push_back(i);
-          break;
-      }
-  }
-
-  auto boolaa = d["aa"].GetBool(); // currently global AA
-  //int bg = d["bgColor"][0].GetInt();
-
-  printf("Preparing glyphs...\n");
-  Fnt.Size = Size;
-  Fnt.HeightConstant = HeightConstant;
-  Fnt.LnSpacingOff = LnSpacingOff;
-  Fnt.CapHeight = CapHeight;
-  Fnt.OriginOffset = OriginOffset;
-  Fnt.DescentPadding = DescentPadding;
-  Fnt.Faces.emplace_back(FacePath);
-  for (auto it = glyphlist.cbegin(); it != glyphlist.cend(); it++) {
-    uint16_t Ch = *it;
-    auto& G = Fnt.Glyphs[Ch];
-    G.reset(new FontGlyph);
-    G->Char = Ch;
-    G->AntiAliasing = boolaa;
-    G->Size = Size;
-    G->FaceIdx = 0;
-    G->HasBmp = false;
-  }
-  printf("Rendering glyphs...\n");
-  Fnt.RenderGlyphsGDI(Size);
-  printf("Reading palette...\n");
-  Palette Pal;
-  Pal.ReadDat(PalPath);
-  printf("Dumping font...\n");
-  Sprite Spr;
-  FontTable Tbl;
-  Fnt.Dump(Spr, Tbl);
-  printf("Saving DC6...\n");
-  Spr.SaveDc6(Dc6Path, Pal);
-  printf("Saving TBL...\n");
-  Tbl.SaveTbl(TblPath);
+  if (watchMode)
+    return Watch(jsonname, d);
+  PrintReports(Build(d, {}));
   printf("All done\n");
   return 0;
 }
@@ -0,0 +1,197 @@
+#include "../Common/Common.hpp"
+#include "../Common/Bitmap.hpp"
+#include "../Common/FontTable.hpp"
+#include "../Common/Sprite.hpp"
+#include "../Common/ThreadPool.hpp"
+
+#include <chrono>
+
+struct LoadedFont {
+  Sprite Spr;
+  FontTable Tbl;
+  vector<int32_t> ByChar = vector<int32_t>(65536, -1); // TBL entry of every char
+
+  void Read(const char* Dc6, const char* Tbl_, const Palette& Pal) {
+    Spr.ReadDc6(Dc6, Pal);
+    Tbl.ReadTbl(Tbl_);
+    if (Spr.NDir() != 1)
+      Abort("%s: the number of directions should be 1 instead of %zu", Dc6, Spr.NDir());
+    for (auto i = 0u; i < Tbl.Hdr.NChar; ++i) {
+      auto& C = Tbl.Chrs[i];
+      if (C.Dc6Index >= Spr.NFrm())
+        Abort("%s: DC6 index (%u) is too large for char (%u)", Tbl_, C.Dc6Index, C.Char);
+      ByChar[C.Char] = (int32_t) i;
+    }
+  }
+
+  const TblChar* Find(uint16_t Ch) const { return ByChar[Ch] < 0 ? nullptr : &Tbl.Chrs[ByChar[Ch]]; }
+  const Bitmap& Image(const TblChar& C) const { return Spr[0][C.Dc6Index]; }
+};
+
+struct GlyphDiff {
+  uint16_t Char;
+  const TblChar* A;
+  const TblChar* B;
+  bool Metrics;
+  PixelDiff Pixels;
+
+  bool Changed() const { return !A || !B || Metrics || Pixels.NChanged; }
+};
+
+// Bmp at the top left of a W x H canvas of transparent pixels
+static Bitmap Pad(const Bitmap& Bmp, size_t W, size_t H) {
+  Bitmap Res(W, H);
+  Res.Fill(0);
+  for (auto y = size_t{0}; y < Bmp.Height(); ++y)
+    copy(Bmp[y], Bmp[y] + Bmp.Width(), Res[y]);
+  return Res;
+}
+
+static PixelDiff Compare(const Bitmap& A, const Bitmap& B) {
+  if (A.Width() == B.Width() && A.Height() == B.Height())
+    return DiffPixels(A.Raw(), B.Raw(), A.Count());
+  // Pixels only one image has are compared against transparency
+  auto W = max(A.Width(), B.Width()), H = max(A.Height(), B.Height());
+  auto PA = Pad(A, W, H), PB = Pad(B, W, H);
+  return DiffPixels(PA.Raw(), PB.Raw(), PA.Count());
+}
+
+// A row per glyph: the image of A, of B, and of A dimmed with the changed
+// pixels in red
+static void SaveGrid(const char* Path, const LoadedFont& FA, const LoadedFont& FB, const vector<GlyphDiff>& Diffs) {
+  constexpr auto Gap = size_t{2};
+  auto CellW = size_t{1}, CellH = size_t{1};
+  for (auto& D : Diffs) {
+    auto& A = FA.Image(*D.A);
+    auto& B = FB.Image(*D.B);
+    CellW = max(CellW, max(A.Width(), B.Width()));
+    CellH = max(CellH, max(A.Height(), B.Height()));
+  }
+  Bitmap Grid(Gap + (CellW + Gap) * 3, Gap + (CellH + Gap) * Diffs.size());
+  Grid.Fill(Pixel(0x404040));
+  for (auto i = size_t{0}; i < Diffs.size(); ++i) {
+    auto& A = FA.Image(*Diffs[i].A);
+    auto& B = FB.Image(*Diffs[i].B);
+    auto W = max(A.Width(), B.Width()), H = max(A.Height(), B.Height());
+    auto PA = Pad(A, W, H), PB = Pad(B, W, H);
+    Bitmap Delta(W, H);
+    for (auto y = size_t{0}; y < H; ++y)
+      for (auto x = size_t{0}; x < W; ++x) {
+        auto& P = PA[y][x];
+        if (P.Rgb() != PB[y][x].Rgb())
+          Delta[y][x] = Pixel(255, 0, 0);
+        else
+          Delta[y][x] = Pixel((uint8_t) (P.R / 3), (uint8_t) (P.G / 3), (uint8_t) (P.B / 3));
+      }
+    auto Y = (int32_t) (Gap + (CellH + Gap) * i);
+    const Bitmap* Cells[]{&PA, &PB, &Delta};
+    for (auto j = size_t{0}; j < 3; ++j) {
+      auto X = (int32_t) (Gap + (CellW + Gap) * j);
+      for (auto y = size_t{0}; y < CellH; ++y)
+        fill(Grid[Y + y] + X, Grid[Y + y] + X + CellW, Pixel(0));
+      Grid.Draw(*Cells[j], X, Y);
+    }
+  }
+  Grid.SavePng(Path);
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 6 && NArg != 7 && NArg != 8) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Diff Font\n"
+      "\n"
+      "Usage: %s <A>.dc6 <A>.tbl <B>.dc6 <B>.tbl <Palette>.dat [<Grid>.png [<TopN>]]\n"
+      "Pair the glyphs of two DC6/TBL fonts by char and compare their metrics\n"
+      "(width, height, UnkTwo, image size) and pixels. Changed chars are listed\n"
+      "most changed pixels first. Given Grid, the TopN (64 by default) most\n"
+      "changed chars present in both fonts are drawn side by side, a row each:\n"
+      "A, B, and the changed pixels in red.\n"
+      "Exits with 1 if the fonts differ.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  auto TopN = NArg == 8 ? (size_t) strtoul(Args[7], nullptr, 10) : size_t{64};
+  printf("Reading palette...\n");
+  Palette Pal;
+  Pal.ReadDat(Args[5]);
+  printf("Reading fonts...\n");
+  LoadedFont FA, FB;
+  FA.Read(Args[1], Args[2], Pal);
+  FB.Read(Args[3], Args[4], Pal);
+
+  auto T0 = chrono::steady_clock::now();
+  vector<GlyphDiff> Diffs;
+  for (auto Ch = 0u; Ch < 65536; ++Ch)
+    if (FA.ByChar[Ch] >= 0 || FB.ByChar[Ch] >= 0)
+      Diffs.push_back({(uint16_t) Ch, FA.Find((uint16_t) Ch), FB.Find((uint16_t) Ch), false, {}});
+  ThreadPool::Global().ParallelFor(Diffs.size(), 64,
+    [&](size_t Beg, size_t End, size_t) {
+      for (auto i = Beg; i < End; ++i) {
+        auto& D = Diffs[i];
+        if (!D.A || !D.B)
+          continue;
+        auto& IA = FA.Image(*D.A);
+        auto& IB = FB.Image(*D.B);
+        D.Metrics = D.A->Width != D.B->Width || D.A->Height != D.B->Height || D.A->UnkTwo != D.B->UnkTwo ||
+          IA.Width() != IB.Width() || IA.Height() != IB.Height();
+        D.Pixels = Compare(IA, IB);
+      }
+    }
+  );
+  auto Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+
+  Diffs.erase(remove_if(Diffs.begin(), Diffs.end(), [](const GlyphDiff& D) { return !D.Changed(); }), Diffs.end());
+  // Missing chars first, then the most changed pixels
+  stable_sort(Diffs.begin(), Diffs.end(), [](const GlyphDiff& L, const GlyphDiff& R) {
+    auto LBoth = L.A && L.B, RBoth = R.A && R.B;
+    if (LBoth != RBoth)
+      return RBoth;
+    if (L.Pixels.NChanged != R.Pixels.NChanged)
+      return L.Pixels.NChanged > R.Pixels.NChanged;
+    if (L.Pixels.MaxDelta != R.Pixels.MaxDelta)
+      return L.Pixels.MaxDelta > R.Pixels.MaxDelta;
+    return L.Metrics > R.Metrics;
+  });
+
+  if (FA.Tbl.Hdr.LnSpacing != FB.Tbl.Hdr.LnSpacing || FA.Tbl.Hdr.CapHeight != FB.Tbl.Hdr.CapHeight)
+    printf("Line spacing %u -> %u, cap height %u -> %u\n", FA.Tbl.Hdr.LnSpacing, FB.Tbl.Hdr.LnSpacing,
+      FA.Tbl.Hdr.CapHeight, FB.Tbl.Hdr.CapHeight);
+  size_t NOnlyA = 0, NOnlyB = 0, NMetrics = 0, NPixels = 0;
+  for (auto& D : Diffs) {
+    if (!D.B) {
+      ++NOnlyA;
+      printf("U+%04X  only in A\n", D.Char);
+      continue;
+    }
+    if (!D.A) {
+      ++NOnlyB;
+      printf("U+%04X  only in B\n", D.Char);
+      continue;
+    }
+    NMetrics += D.Metrics;
+    NPixels += D.Pixels.NChanged != 0;
+    auto& IA = FA.Image(*D.A);
+    auto& IB = FB.Image(*D.B);
+    printf("U+%04X  %6zu px changed, max delta %3u", D.Char, D.Pixels.NChanged, D.Pixels.MaxDelta);
+    if (D.Metrics)
+      printf("  width %u -> %u, height %u -> %u, UnkTwo %u -> %u, image %zux%zu -> %zux%zu",
+        D.A->Width, D.B->Width, D.A->Height, D.B->Height, D.A->UnkTwo, D.B->UnkTwo,
+        IA.Width(), IA.Height(), IB.Width(), IB.Height());
+    printf("\n");
+  }
+  printf("%zu changed chars: %zu only in A, %zu only in B, %zu with other metrics, %zu with other pixels "
+    "(compared in %.1f ms)\n", Diffs.size(), NOnlyA, NOnlyB, NMetrics, NPixels, Ms);
+
+  if (NArg >= 7) {
+    vector<GlyphDiff> Top;
+    for (auto& D : Diffs)
+      if (D.A && D.B && Top.size() < TopN)
+        Top.push_back(D);
+    printf("Saving %zu chars to %s...\n", Top.size(), Args[6]);
+    SaveGrid(Args[6], FA, FB, Top);
+  }
+  return Diffs.empty() ? 0 : 1;
+}
@@ -1,17 +1,100 @@
 #include "../Common/Common.hpp"
 #include "../Common/Bitmap.hpp"
+#include "../Common/MappedFile.hpp"
 #include "../Common/Sprite.hpp"
+#include "../Common/ThreadPool.hpp"
+
+#include <chrono>
+#include <filesystem>
+
+namespace fs = ::std::filesystem;
+
+// Saves every frame as <OutDir>/<dir>-<frame>.png, frames in parallel
+static void DumpFrames(const Sprite& Spr, const fs::path& OutDir) {
+  ThreadPool::Global().ParallelFor(Spr.NDir() * Spr.NFrm(), 1,
+    [&](size_t Beg, size_t End, size_t) {
+      for (auto i = Beg; i < End; ++i) {
+        auto Dir = i / Spr.NFrm(), Frm = i % Spr.NFrm();
+        char Name[32];
+        snprintf(Name, sizeof(Name), "%02zu-%04zu.png", Dir, Frm);
+        Spr[Dir][Frm].SavePng((OutDir / Name).string().c_str());
+      }
+    }
+  );
+}
+
+// Saves the frames as one <Base>.png, a row per direction, and their
+// rectangles and DC6 offsets as <Base>.json
+static void DumpSheet(const Sprite& Spr, const fs::path& Base) {
+  struct Rect {
+    size_t X, Y, W, H;
+  };
+  vector<Rect> Rects(Spr.NDir() * Spr.NFrm());
+  auto W = size_t{1}, H = size_t{0};
+  for (auto Dir = size_t{0}; Dir < Spr.NDir(); ++Dir) {
+    auto X = size_t{0}, RowH = size_t{0};
+    for (auto Frm = size_t{0}; Frm < Spr.NFrm(); ++Frm) {
+      auto& Bmp = Spr[Dir][Frm];
+      Rects[Dir * Spr.NFrm() + Frm] = {X, H, Bmp.Width(), Bmp.Height()};
+      X += Bmp.Width();
+      RowH = max(RowH, Bmp.Height());
+    }
+    W = max(W, X);
+    H += RowH;
+  }
+  Bitmap Sheet(W, max(H, (size_t) 1));
+  Sheet.Fill({});
+  for (auto i = size_t{0}; i < Rects.size(); ++i)
+    if (Rects[i].W && Rects[i].H)
+      Sheet.Draw(Spr[i / Spr.NFrm()][i % Spr.NFrm()], (int32_t) Rects[i].X, (int32_t) Rects[i].Y);
+  auto PngPath = fs::path(Base).replace_extension(".png");
+  Sheet.SavePng(PngPath.string().c_str());
+  auto File = AutoFile(fs::path(Base).replace_extension(".json").string().c_str(), "wb");
+  fprintf(File.Raw(), "{\n  \"image\": \"%s\",\n  \"directions\": %zu,\n  \"framesPerDirection\": %zu,\n  \"frames\": [",
+    PngPath.filename().string().c_str(), Spr.NDir(), Spr.NFrm());
+  for (auto i = size_t{0}; i < Rects.size(); ++i) {
+    auto& R = Rects[i];
+    auto& Hdr = Spr.Headers[i / Spr.NFrm()][i % Spr.NFrm()];
+    fprintf(File.Raw(),
+      "%s\n    {\"direction\": %zu, \"frame\": %zu, \"x\": %zu, \"y\": %zu, \"width\": %zu, \"height\": %zu, "
+      "\"offsetX\": %d, \"offsetY\": %d, \"flip\": %u}",
+      i ? "," : "", i / Spr.NFrm(), i % Spr.NFrm(), R.X, R.Y, R.W, R.H,
+      (int32_t) Hdr.OffsetX, (int32_t) Hdr.OffsetY, Hdr.Flip);
+  }
+  fprintf(File.Raw(), "\n  ]\n}\n");
+}
+
+static void Dump(const fs::path& In, const fs::path& Out, const Palette& Pal, bool AsSheet) {
+  Sprite Spr;
+  {
+    MappedFile File(In.string().c_str());
+    Spr.ReadDc6(File.Data(), File.Size(), Pal);
+  }
+  if (AsSheet) {
+    fs::create_directories(Out.parent_path());
+    DumpSheet(Spr, Out);
+  }
+  else {
+    fs::create_directories(Out);
+    DumpFrames(Spr, Out);
+  }
+}
 
 int main(int NArg, char* Args[]) {
-  if (NArg != 4) {
+  auto AsSheet = NArg == 5 && !strcmp(Args[4], "--sheet");
+  if (NArg != 4 && !AsSheet) {
     fprintf(stderr, "Incorrect command line.\n");
     fprintf(stderr,
       "\n"
       "Dump DC6 File\n"
       "\n"
-      "Usage: %s <Input>.dc6 <Palette>.dat <OutputDir>\n"
+      "Usage: %s <Input>.dc6|<InputDir> <Palette>.dat <OutputDir> [--sheet]\n"
       "Read DC6 file and extract all images.\n"
-      "Use null as the second argument to output grayscale images.\n",
+      "Use null as the second argument to output grayscale images.\n"
+      "A directory is searched recursively for DC6 files, which are dumped in\n"
+      "parallel to the same relative paths under OutputDir.\n"
+      "With --sheet, each DC6 becomes one <name>.png sheet with a row per\n"
+      "direction, and <name>.json with the frame rectangles and offsets.\n",
       Args[0]
     );
     return EXIT_FAILURE;
@@ -20,20 +103,31 @@ int main(int NArg, char* Args[]) {
   Palette Pal;
   Pal.ReadDat(Args[2]);
   printf("Done palette reading\n");
-  printf("Reading DC6: %s...\n", Args[1]);
-  Sprite Spr;
-  Spr.ReadDc6(Args[1], Pal);
-  printf("Done DC6 reading\n");
-  printf("Saving extracted images...\n");
-  for (auto Dir = 0u; Dir < Spr.NDir(); ++Dir)
-    for (auto Frm = 0u; Frm < Spr.NFrm(); ++Frm) {
-      ostringstream OutPath;
-      OutPath << Args[3];
-      OutPath << '/' << setfill('0') << setw(2) << Dir;
-      OutPath << '-' << setfill('0') << setw(4) << Frm;
-      OutPath << ".png";
-      Spr[Dir][Frm].SavePng(OutPath.str().c_str());
+  fs::path In = Args[1], Out = Args[3];
+  if (!fs::is_directory(In)) {
+    printf("Dumping DC6: %s...\n", Args[1]);
+    Dump(In, AsSheet ? Out / In.stem() : Out, Pal, AsSheet);
+    printf("Done image saving...\n");
+    return 0;
+  }
+  vector<fs::path> Files;
+  for (auto& Entry : fs::recursive_directory_iterator(In)) {
+    auto Ext = Entry.path().extension().string();
+    transform(Ext.begin(), Ext.end(), Ext.begin(), [](char Ch) { return (char) tolower(Ch); });
+    if (Entry.is_regular_file() && Ext == ".dc6")
+      Files.push_back(Entry.path());
+  }
+  printf("Dumping %zu DC6 files from %s...\n", Files.size(), Args[1]);
+  auto T0 = chrono::steady_clock::now();
+  // Files are spread over the pool; the frames of each are too, so a few
+  // large files at the end still keep every thread busy
+  ThreadPool::Global().ParallelFor(Files.size(), 1,
+    [&](size_t Beg, size_t End, size_t) {
+      for (auto i = Beg; i < End; ++i)
+        Dump(Files[i], (Out / fs::relative(Files[i], In)).replace_extension(), Pal, AsSheet);
     }
-  printf("Done image saving...\n");
+  );
+  auto Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+  printf("Done %zu files in %.0f ms\n", Files.size(), Ms);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,48 @@
+#include "../Common/Common.hpp"
+#include "../Common/Atlas.hpp"
+#include "../Common/Bitmap.hpp"
+#include "../Common/Font.hpp"
+#include "../Common/FontTable.hpp"
+#include "../Common/Sprite.hpp"
+
+#include <filesystem>
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 5 && NArg != 6) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Export BMFont\n"
+      "\n"
+      "Usage: %s <Input>.dc6 <Input>.tbl <Palette>.dat <Output> [<PageSize>]\n"
+      "Pack the glyphs of a DC6/TBL font into <Output>_<page>.png atlas pages\n"
+      "(256x256 by default) described by the BMFont text file <Output>.fnt.\n"
+      "Chars with identical images share one atlas rectangle.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  auto PageSize = NArg == 6 ? (uint32_t) strtoul(Args[5], nullptr, 10) : 256u;
+  if (!PageSize)
+    Abort("Invalid page size: %s", Args[5]);
+  printf("Reading palette...\n");
+  Palette Pal;
+  Pal.ReadDat(Args[3]);
+  printf("Reading DC6...\n");
+  Sprite Spr;
+  Spr.ReadDc6(Args[1], Pal);
+  printf("Reading TBL...\n");
+  FontTable Tbl;
+  Tbl.ReadTbl(Args[2]);
+  printf("Constructing font...\n");
+  Font Fnt;
+  Fnt.FromSprTbl(Spr, Tbl);
+  printf("Packing atlas...\n");
+  FontAtlas Atlas;
+  Atlas.Pack(Fnt, PageSize);
+  printf("%zu chars, %zu distinct images on %zu pages\n", Atlas.Chars.size(), Atlas.Rects.size(), Atlas.Pages.size());
+  printf("Saving...\n");
+  Atlas.SaveBmFont(Fnt, Args[4], filesystem::path(Args[1]).stem().string());
+  printf("All done\n");
+  return 0;
+}
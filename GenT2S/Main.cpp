@@ -0,0 +1,42 @@
+#include <windows.h>
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 2) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Generate Traditional to Simplified Chinese Table\n"
+      "\n"
+      "Usage: %s <Output>.inc\n"
+      "Map every BMP codepoint with LCMapStringW and write the changed ones\n"
+      "in the format of Common/T2SData.inc.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  // Surrogates and NUL are left out; everything else goes in one call
+  vector<wchar_t> Src;
+  for (auto Ch = 1u; Ch < 0x10000; ++Ch)
+    if (Ch < 0xd800 || Ch > 0xdfff)
+      Src.push_back((wchar_t) Ch);
+  vector<wchar_t> Dst(Src.size());
+  auto Len = LCMapStringW(0x0804, LCMAP_SIMPLIFIED_CHINESE, Src.data(), (int) Src.size(), Dst.data(), (int) Dst.size());
+  if (Len != (int) Src.size())
+    Abort("LCMapStringW failed (%d), error %lu", Len, GetLastError());
+  auto File = AutoFile(Args[1], "w");
+  fputs("// Traditional to simplified Chinese pairs {From, To}, sorted by From.\n", File.Raw());
+  fputs("// Generated by GenT2S from LCMapStringW (LCMAP_SIMPLIFIED_CHINESE).\n", File.Raw());
+  auto N = 0u;
+  for (auto i = size_t{0}; i < Src.size(); ++i) {
+    if (Src[i] == Dst[i])
+      continue;
+    fprintf(File.Raw(), "{0x%04x, 0x%04x},", (unsigned) Src[i], (unsigned) Dst[i]);
+    fputc(++N % 6 ? ' ' : '\n', File.Raw());
+  }
+  if (N % 6)
+    fputc('\n', File.Raw());
+  printf("%u pairs written\n", N);
+  return 0;
+}
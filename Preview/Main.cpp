@@ -2,39 +2,139 @@
 #include <fcntl.h>
 #include "../Common/Common.hpp"
 #include "../Common/Bitmap.hpp"
+#include "../Common/CompiledFont.hpp"
+#include "../Common/Corpus.hpp"
 #include "../Common/Font.hpp"
 #include "../Common/FontTable.hpp"
+#include "../Common/MappedFile.hpp"
 #include "../Common/Sprite.hpp"
 
+#include <filesystem>
+
+// Renders every line of a UTF-8 or UTF-16 file: Out is a directory that
+// gets <line>.png per non-empty line, or a .png that gets them all stacked
+static void RenderLines(Font& Fnt, const char* TextPath, const string& Out) {
+  wstring Text;
+  {
+    MappedFile File(TextPath);
+    if (auto NSkip = DecodeText(File.Data(), File.Size(), Text))
+      Warn("%zu codepoints are outside the BMP or malformed and are ignored", NSkip);
+  }
+  vector<wstring> Strs;
+  vector<size_t> LineNos;
+  auto LineNo = size_t{0};
+  for (size_t Beg = 0, End; Beg <= Text.size(); Beg = End + 1) {
+    End = min(Text.find(L'\n', Beg), Text.size());
+    ++LineNo;
+    auto Line = Text.substr(Beg, End - Beg);
+    if (!Line.empty() && Line.back() == L'\r')
+      Line.pop_back();
+    if (Line.empty())
+      continue;
+    Strs.emplace_back(move(Line));
+    LineNos.push_back(LineNo);
+  }
+  auto Sheet = Out.size() > 4 && Out.compare(Out.size() - 4, 4, ".png") == 0;
+  printf("Rendering %zu lines...\n", Strs.size());
+  vector<Bitmap> Bmps(Sheet ? Strs.size() : 0);
+  vector<vector<wchar_t>> Missing(Strs.size());
+  Fnt.RenderBatch(Strs, [&](size_t Idx, const Bitmap& Bmp, const vector<wchar_t>& Miss) {
+    Missing[Idx] = Miss;
+    if (Sheet)
+      Bmps[Idx] = Bmp;
+    else if (Bmp.Width() && Bmp.Height())
+      Bmp.SavePng((Out + "/" + to_string(LineNos[Idx]) + ".png").c_str());
+  });
+  if (Sheet) {
+    // One line per string, 2 pixels apart
+    auto W = size_t{1}, H = size_t{0};
+    for (auto& Bmp : Bmps) {
+      W = max(W, Bmp.Width());
+      H += Bmp.Height() + 2;
+    }
+    Bitmap All(W, max(H, (size_t) 1));
+    All.Fill({});
+    auto Y = int32_t{0};
+    for (auto& Bmp : Bmps) {
+      if (Bmp.Width() && Bmp.Height())
+        All.Draw(Bmp, 0, Y);
+      Y += (int32_t) Bmp.Height() + 2;
+    }
+    printf("Saving PNG...\n");
+    All.SavePng(Out.c_str());
+  }
+  // Report lines drawn with the fallback glyph
+  vector<bool> Seen(65536);
+  auto NLine = size_t{0};
+  for (auto i = size_t{0}; i < Strs.size(); ++i) {
+    if (Missing[i].empty())
+      continue;
+    if (++NLine <= 20) {
+      printf("Line %zu lacks", LineNos[i]);
+      for (auto Ch : Missing[i])
+        printf(" U+%04X", (unsigned) Ch);
+      printf("\n");
+    }
+    for (auto Ch : Missing[i])
+      Seen[(uint16_t) Ch] = true;
+  }
+  if (NLine)
+    Warn("%zu lines use chars the font lacks (%zu distinct), drawn as '%lc'",
+      NLine, (size_t) count(Seen.begin(), Seen.end(), true), (wint_t) Fnt.FallbackChar);
+}
+
 int main(int NArg, char* Args[]) {
     _setmode(_fileno(stdin), _O_WTEXT);
-  if (NArg != 5) {
+  // A compiled font stands for the DC6, TBL and palette arguments
+  auto Compiled = NArg > 1 && filesystem::path(Args[1]).extension() == ".d2cf";
+  auto NFontArg = Compiled ? 1 : 3;
+  if (NArg != NFontArg + 2 && NArg != NFontArg + 3) {
     fprintf(stderr, "Incorrect command line.\n");
     fprintf(stderr,
       "\n"
       "Dump DC6 File\n"
       "\n"
-      "Usage: %s <Input>.dc6 <Input>.tbl <Palette>.dat <Output>.png\n"
-      "Render text using provided dc6 and tbl.\n"
-      "Text should be given in standard input.\n",
-      Args[0]
+      "Usage: %s <Input>.dc6 <Input>.tbl <Palette>.dat <Output>.png [<Lines>.txt]\n"
+      "       %s <Input>.d2cf <Output>.png [<Lines>.txt]\n"
+      "Render text using provided dc6 and tbl, or a font made by CompileFont.\n"
+      "Text should be given in standard input; \"\\xffc\" color codes make the\n"
+      "output a paletted PNG.\n"
+      "With a lines file, every line is rendered: to <Output>/<line>.png if\n"
+      "Output is a directory, or stacked into one sheet if it is a .png.\n",
+      Args[0], Args[0]
     );
     return EXIT_FAILURE;
   }
-  printf("Reading palette...\n");
+  auto OutPath = Args[NFontArg + 1];
   Palette Pal;
-  Pal.ReadDat(Args[3]);
-  printf("Reading DC6...\n");
-  Sprite Spr;
-  Spr.ReadDc6(Args[1], Pal);
-  printf("Reading TBL...\n");
-  FontTable Tbl;
-  Tbl.ReadTbl(Args[2]);
-  printf("LnSpacing=%u\n", Tbl.Hdr.LnSpacing);
-  printf("CapHeight=%u\n", Tbl.Hdr.CapHeight);
-  printf("Constructing font...\n");
   Font Fnt;
-  Fnt.FromSprTbl(Spr, Tbl);
+  CompiledFont Cf;
+  if (Compiled) {
+    printf("Mapping compiled font...\n");
+    if (!Cf.Open(Args[1]))
+      return EXIT_FAILURE;
+    Pal = Cf.Pal();
+    Fnt.FromCompiled(Cf);
+  }
+  else {
+    printf("Reading palette...\n");
+    Pal.ReadDat(Args[3]);
+    printf("Reading DC6...\n");
+    IndexedSprite Spr;
+    Spr.ReadDc6(Args[1]);
+    printf("Reading TBL...\n");
+    FontTable Tbl;
+    Tbl.ReadTbl(Args[2]);
+    printf("Constructing font...\n");
+    Fnt.FromSprTbl(Spr, Tbl, Pal);
+  }
+  printf("LnSpacing=%u\n", Fnt.LnSpacing);
+  printf("CapHeight=%u\n", Fnt.CapHeight);
+  if (NArg == NFontArg + 3) {
+    RenderLines(Fnt, Args[NFontArg + 2], OutPath);
+    printf("All done\n");
+    return 0;
+  }
   wstring Str;
   printf("Ready, type some text below:\n");
   auto Ch = (wchar_t) getwchar();
@@ -44,9 +144,29 @@ int main(int NArg, char* Args[]) {
   }
   while (!Str.empty() && Str.back() == '\n')
     Str.pop_back();
-  auto Bmp = Fnt.Render(Str);
-  printf("Saving PNG...\n");
-  Bmp.SavePng(Args[4]);
+  vector<wchar_t> Missing;
+  if (Str.find(L"\xff" L"c") != wstring::npos) {
+    // Colored text stays in palette indices, recolored by table lookups
+    printf("Rendering colored text...\n");
+    auto Bmp = Fnt.RenderIndexed(Str, TextColors(Pal), &Missing);
+    printf("Saving PNG...\n");
+    Bmp.SavePng(OutPath, Pal);
+  }
+  else {
+    // Drawn and saved a band at a time, so long input never needs the whole
+    // image in memory
+    printf("Rendering and saving PNG...\n");
+    if (!Fnt.RenderBands(Str, OutPath, &Missing))
+      return EXIT_FAILURE;
+  }
+  sort(Missing.begin(), Missing.end());
+  Missing.erase(unique(Missing.begin(), Missing.end()), Missing.end());
+  if (!Missing.empty()) {
+    printf("Font lacks %zu chars:", Missing.size());
+    for (auto Ch : Missing)
+      printf(" U+%04X", (unsigned) Ch);
+    printf("\n");
+  }
   printf("All done\n");
   return 0;
 }
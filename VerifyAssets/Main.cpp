@@ -0,0 +1,151 @@
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+#include "../Common/MappedFile.hpp"
+#include "../Common/ThreadPool.hpp"
+#include "../Common/Verify.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+
+namespace fs = ::std::filesystem;
+
+static string Lower(string Str) {
+  transform(Str.begin(), Str.end(), Str.begin(), [](char Ch) { return (char) tolower(Ch); });
+  return Str;
+}
+
+// JSON string body; paths are written with forward slashes
+static string Escape(const string& Str) {
+  string Res;
+  for (auto Ch : Str) {
+    if (Ch == '"' || Ch == '\\')
+      Res += '\\';
+    if ((unsigned char) Ch >= 0x20)
+      Res += Ch;
+  }
+  return Res;
+}
+
+static void WriteIssues(FILE* File, const char* Key, const vector<string>& Issues) {
+  fprintf(File, ", \"%s\": [", Key);
+  for (auto i = size_t{0}; i < Issues.size(); ++i)
+    fprintf(File, "%s\"%s\"", i ? ", " : "", Escape(Issues[i]).c_str());
+  fprintf(File, "]");
+}
+
+static void WriteCatalog(const char* Path, const vector<AssetReport>& Reps) {
+  auto File = AutoFile(Path, "wb");
+  fprintf(File.Raw(), "[");
+  for (auto i = size_t{0}; i < Reps.size(); ++i) {
+    auto& R = Reps[i];
+    fprintf(File.Raw(), "%s\n  {\"path\": \"%s\", \"type\": \"%s\", \"ok\": %s", i ? "," : "",
+      Escape(R.Path).c_str(), R.IsTbl ? "tbl" : "dc6", R.Errors.empty() ? "true" : "false");
+    if (R.IsTbl) {
+      fprintf(File.Raw(), ", \"chars\": %u, \"lnSpacing\": %u, \"capHeight\": %u, \"coverage\": [",
+        R.NChar, R.LnSpacing, R.CapHeight);
+      auto First = true;
+      for (auto [Lo, Hi] : R.Chars.Ranges()) {
+        fprintf(File.Raw(), "%s[%u, %u]", First ? "" : ", ", Lo, Hi);
+        First = false;
+      }
+      fprintf(File.Raw(), "]");
+    }
+    else
+      fprintf(File.Raw(), ", \"directions\": %u, \"framesPerDirection\": %u, \"maxWidth\": %u, \"maxHeight\": %u",
+        R.NDir, R.NFrm, R.MaxW, R.MaxH);
+    WriteIssues(File.Raw(), "errors", R.Errors);
+    WriteIssues(File.Raw(), "warnings", R.Warnings);
+    fprintf(File.Raw(), "}");
+  }
+  fprintf(File.Raw(), "\n]\n");
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 3) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Verify Assets\n"
+      "\n"
+      "Usage: %s <InputDir> <Catalog>.json\n"
+      "Check every DC6 and TBL under InputDir, in parallel and without decoding\n"
+      "images, and list their sizes, frame counts and char coverage in Catalog.\n"
+      "A TBL is checked against the DC6 of the same name next to it.\n"
+      "Exits with 1 if any file would fail to load.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  fs::path In = Args[1];
+  vector<fs::path> Dc6s, Tbls;
+  error_code Ec;
+  for (fs::recursive_directory_iterator It(In, fs::directory_options::skip_permission_denied, Ec), End;
+    !Ec && It != End; It.increment(Ec)) {
+    if (!It->is_regular_file(Ec))
+      continue;
+    auto Ext = Lower(It->path().extension().string());
+    if (Ext == ".dc6")
+      Dc6s.push_back(It->path());
+    else if (Ext == ".tbl")
+      Tbls.push_back(It->path());
+  }
+  if (Ec)
+    Warn("Stopped searching %s: %s", Args[1], Ec.message().c_str());
+  sort(Dc6s.begin(), Dc6s.end());
+  sort(Tbls.begin(), Tbls.end());
+  printf("Verifying %zu DC6 and %zu TBL files...\n", Dc6s.size(), Tbls.size());
+  auto T0 = chrono::steady_clock::now();
+  // DC6 files go first, as each TBL is checked against its DC6's frame count
+  vector<AssetReport> Reps(Dc6s.size() + Tbls.size());
+  auto Verify = [&](size_t i, const fs::path& Path, uint32_t NFrm) {
+    auto& Rep = Reps[i];
+    // Ec belongs to the directory walk; pool threads each need their own
+    error_code RelEc;
+    auto Rel = fs::relative(Path, In, RelEc);
+    Rep.Path = (RelEc || Rel.empty() ? Path : Rel).generic_string();
+    Rep.IsTbl = i >= Dc6s.size();
+    MappedFile File;
+    if (!File.TryOpen(Path.string().c_str()))
+      Rep.Error("Cannot be read");
+    else if (Rep.IsTbl)
+      VerifyTbl(File.Data(), File.Size(), NFrm, Rep);
+    else
+      VerifyDc6(File.Data(), File.Size(), Rep);
+  };
+  auto& Pool = ThreadPool::Global();
+  Pool.ParallelFor(Dc6s.size(), 1,
+    [&](size_t Beg, size_t End, size_t) {
+      for (auto i = Beg; i < End; ++i)
+        Verify(i, Dc6s[i], 0);
+    }
+  );
+  map<string, uint32_t> NFrms;
+  for (auto i = size_t{0}; i < Dc6s.size(); ++i)
+    if (Reps[i].Errors.empty() && Reps[i].NDir == 1)
+      NFrms[Lower(fs::path(Dc6s[i]).replace_extension().string())] = Reps[i].NFrm;
+  Pool.ParallelFor(Tbls.size(), 1,
+    [&](size_t Beg, size_t End, size_t) {
+      for (auto i = Beg; i < End; ++i) {
+        auto It = NFrms.find(Lower(fs::path(Tbls[i]).replace_extension().string()));
+        Verify(Dc6s.size() + i, Tbls[i], It == NFrms.end() ? 0 : It->second);
+      }
+    }
+  );
+  auto Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+  auto NBad = size_t{0}, NOdd = size_t{0};
+  for (auto& R : Reps) {
+    if (R.Errors.empty() && R.Warnings.empty())
+      continue;
+    NBad += !R.Errors.empty();
+    NOdd += R.Errors.empty();
+    printf("%s\n", R.Path.c_str());
+    for (auto& E : R.Errors)
+      printf("  error: %s\n", E.c_str());
+    for (auto& W : R.Warnings)
+      printf("  warning: %s\n", W.c_str());
+  }
+  WriteCatalog(Args[2], Reps);
+  printf("%zu files in %.0f ms: %zu with errors, %zu with warnings only\n", Reps.size(), Ms, NBad, NOdd);
+  return NBad ? EXIT_FAILURE : 0;
+}